@@ -0,0 +1,176 @@
+/**
+ * \file alarm.c
+ * \brief ADC channel window alarms
+ *
+ * Compares every result of a channel with a level or window as the sampler stores it
+ * and sends one UDP notification when the condition trips, so the host does not have
+ * to poll `@adc` to find out when a channel leaves its safe band.
+ *
+ * Additional information can be found in the [Alarm Guide](\ref AlarmGuide) page.
+ *
+ */
+
+/**
+ * \page AlarmGuide Alarm Guide
+ *
+ * Operation
+ * - alarm_check() is called from the sampler interrupt with each corrected result of a channel that has an alarm
+ * - When the condition trips the result is kept and the channel is marked for alarm_tick() in the main loop
+ * - The alarm then waits until the result has moved back past the level by the hysteresis before it can trip again
+ * - A notification is only queued when the GainSpan TX buffer is empty so it cannot corrupt a `CAP` datagram
+ *
+ * ADCA has a single compare register shared by all channels and each channel interrupt is already
+ * used to complete sweeps, so the comparison is done on the results instead of by the ADC compare modes.
+ * This also allows windows and works in every sampler mode, including oversampled and DMA results.
+ *
+ * Alarm types
+ * - `a` above, result at or above `<level>`
+ * - `b` below, result at or below `<level>`
+ * - `i` inside, result from `<low>` to `<high>`
+ * - `o` outside, result below `<low>` or above `<high>`
+ * - `n` off
+ *
+ * Levels are in the same counts as the channel results, see the [Sampler Guide](\ref SamplerGuide).
+ * No result is checked while the sampler is off.
+ *
+ * UDP commands
+ * - `@alarm<ch>,<a|b>,<level>` or `@alarm<ch>,<i|o>,<low>,<high>` sets and arms alarm of channel, `@alarm<ch>,n` turns off,
+ *   replies `ALARMSET<ch>:<type>`, type 0 off, 1 above, 2 below, 3 inside, 4 outside
+ *
+ * Notification
+ * - `ALARM<ch>:<type>:<result>` with the result that tripped the alarm
+ *
+ * Defined in \ref alarm.c
+ */
+
+
+#include <asf.h>
+#include <stdio.h>
+
+#include "hardware.h"
+#include "gainspan.h"
+#include "sampler.h"
+#include "alarm.h"
+
+
+static const char alarm_codes[] = "nabio";	/**< Command letter of each alarm type */
+
+
+
+/**
+ * \fn void alarm_set(uint8_t ch, enum alarm_types type, uint16_t low, uint16_t high)
+ * \brief Sets alarm of channel and arms it.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param type Condition that trips the alarm
+ * \param low Level for below, lower edge of window
+ * \param high Level for above, upper edge of window
+ *
+ * Any notification of the channel not yet sent is dropped.
+ */
+void alarm_set(uint8_t ch, enum alarm_types type, uint16_t low, uint16_t high)
+{
+	irqflags_t flags;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return;
+	flags = cpu_irq_save();
+	alarm_conf[ch].type = type;
+	alarm_conf[ch].low = low;
+	alarm_conf[ch].high = high;
+	alarm_conf[ch].hyst = ALARM_HYST_DEFAULT;
+	alarm_tripped &= ~(1 << ch);
+	if (type == ALARM_TYPE_OFF) alarm_armed &= ~(1 << ch);
+	else alarm_armed |= (1 << ch);
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void alarm_check(uint8_t ch, uint16_t val)
+ * \brief Checks result of channel.
+ * \param ch Channel number
+ * \param val Corrected result
+ *
+ * Called from the sampler interrupt.
+ */
+void alarm_check(uint8_t ch, uint16_t val)
+{
+	int32_t v;
+	int32_t lo;
+	int32_t hi;
+	int32_t hyst;
+	bool in;
+	bool clear;
+
+	v = val;
+	lo = alarm_conf[ch].low;
+	hi = alarm_conf[ch].high;
+	hyst = alarm_conf[ch].hyst;
+	switch (alarm_conf[ch].type)
+	{
+		case ALARM_TYPE_ABOVE:
+			in = (v >= hi);
+			clear = ((v + hyst) < hi);
+			break;
+		case ALARM_TYPE_BELOW:
+			in = (v <= lo);
+			clear = (v > (lo + hyst));
+			break;
+		case ALARM_TYPE_INSIDE:
+			in = ((v >= lo) && (v <= hi));
+			clear = (((v + hyst) < lo) || (v > (hi + hyst)));
+			break;
+		case ALARM_TYPE_OUTSIDE:
+			in = ((v < lo) || (v > hi));
+			clear = ((v >= (lo + hyst)) && ((v + hyst) <= hi));
+			break;
+		default:
+			return;
+	}
+
+	if (alarm_armed & (1 << ch))
+	{	// Trip once
+		if (!in) return;
+		alarm_value[ch] = val;
+		alarm_armed &= ~(1 << ch);
+		alarm_tripped |= (1 << ch);
+	}
+	else if (clear) alarm_armed |= (1 << ch);
+}
+
+
+
+/**
+ * \fn void alarm_tick(void)
+ * \brief Sends notification of tripped alarms.
+ *
+ * Called from main loop. Queues at most one notification and only when the GainSpan
+ * TX buffer is empty.
+ */
+void alarm_tick(void)
+{
+	char buf[24];
+	irqflags_t flags;
+	uint8_t ch;
+	uint16_t value;
+	char code;
+
+	if (alarm_tripped == 0) return;
+	if (gainspan_head_tx != gainspan_tail_tx) return;
+
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+	{
+		if (alarm_tripped & (1 << ch))
+		{
+			// Copy under lock, format with interrupts running
+			flags = cpu_irq_save();
+			value = alarm_value[ch];
+			code = alarm_codes[alarm_conf[ch].type];
+			alarm_tripped &= ~(1 << ch);
+			cpu_irq_restore(flags);
+			sprintf(buf, "ALARM%u:%c:%u", ch, code, value);
+			gainspan_TXdata(buf);
+			return;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/**
+ * \file alarm.h
+ * \brief Handles ADC channel window alarms
+ *
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+
+#define ALARM_HYST_DEFAULT		16		/**< Counts the result must move back before an alarm can trip again */
+
+
+enum alarm_types
+{
+	ALARM_TYPE_OFF,
+	ALARM_TYPE_ABOVE,
+	ALARM_TYPE_BELOW,
+	ALARM_TYPE_INSIDE,
+	ALARM_TYPE_OUTSIDE
+};	/**< Alarm type enumerations, two levels and two windows */
+
+
+struct alarm_config
+{
+	enum alarm_types type;	/**< Condition that trips the alarm */
+	uint16_t low;			/**< Level for below, lower edge of window */
+	uint16_t high;			/**< Level for above, upper edge of window */
+	uint16_t hyst;			/**< Hysteresis in ADC counts */
+};	/**< Alarm settings of one channel */
+
+
+struct alarm_config alarm_conf[SAMPLER_NR_OF_CHANNELS];	/**< Alarm settings of each channel */
+volatile uint8_t alarm_armed;		/**< Bit mask of channels waiting for their condition */
+volatile uint8_t alarm_tripped;		/**< Bit mask of channels tripped and not yet notified */
+volatile uint16_t alarm_value[SAMPLER_NR_OF_CHANNELS];	/**< Result that tripped each channel */
+
+
+
+/**
+ * \fn void alarm_set(uint8_t ch, enum alarm_types type, uint16_t low, uint16_t high)
+ * \brief Sets alarm of channel and arms it.
+ */
+void alarm_set(uint8_t ch, enum alarm_types type, uint16_t low, uint16_t high);
+
+
+/**
+ * \fn void alarm_check(uint8_t ch, uint16_t val)
+ * \brief Checks result of channel. Called from sampling interrupt.
+ */
+void alarm_check(uint8_t ch, uint16_t val);
+
+
+/**
+ * \fn void alarm_tick(void)
+ * \brief Sends notification of tripped alarms. Called from main loop.
+ */
+void alarm_tick(void);
+
+
+#endif // ALARM_H
@@ -60,6 +60,9 @@
 // From module: DAC - Digital to Analog Converter
 #include <dac.h>
 
+// From module: DMA - Direct Memory Access Controller
+#include <dma.h>
+
 // From module: GPIO - General purpose Input/Output
 #include <gpio.h>
 
@@ -0,0 +1,188 @@
+/**
+ * \file
+ *
+ * \brief AVR XMEGA Direct Memory Access Controller driver
+ *
+ */
+#include <compiler.h>
+#include <interrupt.h>
+#include <sleepmgr.h>
+#include <dma.h>
+
+/**
+ * \ingroup dma_group
+ *
+ * @{
+ */
+
+//! \internal Channel interrupt callbacks
+static dma_callback_t dma_data_callback[DMA_NUMBER_OF_CHANNELS];
+
+/**
+ * \brief Enable DMA controller
+ *
+ * Enables the peripheral clock, resets the controller and enables it.
+ */
+void dma_enable(void)
+{
+	sysclk_enable_module(SYSCLK_PORT_GEN, SYSCLK_DMA);
+	sleepmgr_lock_mode(SLEEPMGR_IDLE);
+
+	// Reset controller before enabling it
+	DMA.CTRL = 0;
+	DMA.CTRL = DMA_RESET_bm;
+	while (DMA.CTRL & DMA_RESET_bm) {
+		// Wait for reset to complete
+	}
+
+	DMA.CTRL = DMA_ENABLE_bm;
+}
+
+/**
+ * \brief Disable DMA controller
+ */
+void dma_disable(void)
+{
+	DMA.CTRL = 0;
+	sysclk_disable_module(SYSCLK_PORT_GEN, SYSCLK_DMA);
+	sleepmgr_unlock_mode(SLEEPMGR_IDLE);
+}
+
+/**
+ * \brief Write configuration to DMA channel
+ *
+ * \param num DMA channel number 0 to 3.
+ * \param config Pointer to DMA channel configuration.
+ *
+ * \note The channel is left disabled, enable it with \ref dma_channel_enable .
+ */
+void dma_channel_write_config(dma_channel_num_t num,
+		struct dma_channel_config *config)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+	irqflags_t flags = cpu_irq_save();
+
+	// Reset channel before writing new configuration
+	channel->CTRLA &= ~DMA_CH_ENABLE_bm;
+	channel->CTRLA = DMA_CH_RESET_bm;
+
+	channel->REPCNT = config->repcnt;
+	channel->CTRLA = config->ctrla & ~DMA_CH_ENABLE_bm;
+	channel->CTRLB = config->ctrlb & (DMA_CH_ERRINTLVL_gm | DMA_CH_TRNINTLVL_gm);
+	channel->ADDRCTRL = config->addrctrl;
+	channel->TRIGSRC = config->trigsrc;
+	channel->TRFCNT = config->trfcnt;
+
+	channel->SRCADDR0 = config->srcaddr & 0xff;
+	channel->SRCADDR1 = config->srcaddr >> 8;
+	channel->SRCADDR2 = 0;
+
+	channel->DESTADDR0 = config->destaddr & 0xff;
+	channel->DESTADDR1 = config->destaddr >> 8;
+	channel->DESTADDR2 = 0;
+
+	cpu_irq_restore(flags);
+}
+
+/**
+ * \brief Set channel interrupt callback
+ *
+ * \param num DMA channel number 0 to 3.
+ * \param callback Function called on transfer complete or error, NULL for none.
+ */
+void dma_set_callback(dma_channel_num_t num, dma_callback_t callback)
+{
+	Assert(num < DMA_NUMBER_OF_CHANNELS);
+
+	dma_data_callback[num] = callback;
+}
+
+/**
+ * \brief Get DMA channel status
+ *
+ * \param num DMA channel number 0 to 3.
+ *
+ * \note Reading a completed or error status clears it.
+ */
+enum dma_channel_status dma_get_channel_status(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+	uint8_t ctrlb = channel->CTRLB;
+
+	if (ctrlb & DMA_CH_ERRIF_bm) {
+		channel->CTRLB |= DMA_CH_ERRIF_bm;
+		return DMA_CH_TRANSFER_ERROR;
+	} else if (ctrlb & DMA_CH_CHBUSY_bm) {
+		return DMA_CH_BUSY;
+	} else if (ctrlb & DMA_CH_CHPEND_bm) {
+		return DMA_CH_PENDING;
+	} else if (ctrlb & DMA_CH_TRNIF_bm) {
+		channel->CTRLB |= DMA_CH_TRNIF_bm;
+		return DMA_CH_TRANSFER_COMPLETED;
+	}
+
+	return DMA_CH_FREE;
+}
+
+/**
+ * \internal
+ * \brief Common channel interrupt handling
+ *
+ * Clears the interrupt flags and calls the channel callback.
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static void dma_interrupt(const dma_channel_num_t num)
+{
+	enum dma_channel_status status;
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+
+	if (channel->CTRLB & DMA_CH_ERRIF_bm) {
+		status = DMA_CH_TRANSFER_ERROR;
+	} else {
+		status = DMA_CH_TRANSFER_COMPLETED;
+	}
+	channel->CTRLB |= DMA_CH_ERRIF_bm | DMA_CH_TRNIF_bm;
+
+	if (dma_data_callback[num]) {
+		dma_data_callback[num](status);
+	}
+}
+
+/**
+ * \internal
+ * \brief DMA channel 0 interrupt handler
+ */
+ISR(DMA_CH0_vect)
+{
+	dma_interrupt(0);
+}
+
+/**
+ * \internal
+ * \brief DMA channel 1 interrupt handler
+ */
+ISR(DMA_CH1_vect)
+{
+	dma_interrupt(1);
+}
+
+/**
+ * \internal
+ * \brief DMA channel 2 interrupt handler
+ */
+ISR(DMA_CH2_vect)
+{
+	dma_interrupt(2);
+}
+
+/**
+ * \internal
+ * \brief DMA channel 3 interrupt handler
+ */
+ISR(DMA_CH3_vect)
+{
+	dma_interrupt(3);
+}
+
+//! @}
@@ -0,0 +1,403 @@
+/**
+ * \file
+ *
+ * \brief AVR XMEGA Direct Memory Access Controller driver
+ *
+ */
+#ifndef DMA_H
+#define DMA_H
+
+#include <compiler.h>
+#include <sysclk.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup dma_group Direct Memory Access Controller (DMA)
+ *
+ * This is a driver for the AVR XMEGA DMA controller. It provides functions for
+ * enabling and disabling the controller, configuring the four DMA channels and
+ * setting a callback for channel transfer complete and error interrupts.
+ *
+ * The API makes use of a structure that contains the channel configuration.
+ * This structure must be set up before the configuration is written to a DMA
+ * channel with \ref dma_channel_write_config. A channel must be disabled
+ * before its configuration is changed.
+ *
+ * \pre The functions for creating/changing configurations are not protected
+ * against interrupts. The functions that read from or write to the DMA
+ * registers are protected.
+ *
+ * @{
+ */
+
+//! Number of DMA channels
+#define DMA_NUMBER_OF_CHANNELS    4
+
+//! DMA channel number
+typedef uint8_t dma_channel_num_t;
+
+//! DMA channel status
+enum dma_channel_status {
+	//! Channel is idle
+	DMA_CH_FREE = 0,
+	//! Channel is transferring data
+	DMA_CH_BUSY,
+	//! Channel has a transfer pending
+	DMA_CH_PENDING,
+	//! Channel has completed a block transfer
+	DMA_CH_TRANSFER_COMPLETED,
+	//! Channel has stopped because of a bus error
+	DMA_CH_TRANSFER_ERROR,
+};
+
+//! DMA channel interrupt levels
+enum dma_int_level_t {
+	DMA_INT_LVL_OFF = 0x00,
+	DMA_INT_LVL_LO = 0x01,
+	DMA_INT_LVL_MED = 0x02,
+	DMA_INT_LVL_HI = 0x03,
+};
+
+/**
+ * \brief DMA channel interrupt callback function type
+ *
+ * Called from the channel interrupt with \ref DMA_CH_TRANSFER_COMPLETED or
+ * \ref DMA_CH_TRANSFER_ERROR.
+ */
+typedef void (*dma_callback_t)(enum dma_channel_status status);
+
+//! DMA channel configuration
+struct dma_channel_config {
+	uint8_t ctrla;
+	uint8_t ctrlb;
+	uint8_t addrctrl;
+	uint8_t trigsrc;
+	uint16_t trfcnt;
+	uint8_t repcnt;
+	uint16_t srcaddr;
+	uint16_t destaddr;
+};
+
+/**
+ * \internal
+ * \brief Get pointer to DMA channel registers
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline DMA_CH_t *dma_get_channel_address_from_num(dma_channel_num_t num)
+{
+	Assert(num < DMA_NUMBER_OF_CHANNELS);
+
+	return (DMA_CH_t *)((uintptr_t)&DMA.CH0 + (sizeof(DMA_CH_t) * num));
+}
+
+//! \name DMA controller management
+//@{
+
+void dma_enable(void);
+void dma_disable(void);
+
+/**
+ * \brief Set DMA channel priority mode
+ *
+ * \param primode Priority mode, for example \c DMA_PRIMODE_CH0123_gc .
+ */
+static inline void dma_set_priority_mode(DMA_PRIMODE_t primode)
+{
+	irqflags_t flags = cpu_irq_save();
+	DMA.CTRL = (DMA.CTRL & ~DMA_PRIMODE_gm) | primode;
+	cpu_irq_restore(flags);
+}
+
+/**
+ * \brief Set DMA double buffer mode
+ *
+ * In double buffer mode a channel pair alternates: when one channel completes
+ * its block the other channel is enabled.
+ *
+ * \param dbufmode Double buffer mode, for example \c DMA_DBUFMODE_CH01_gc .
+ */
+static inline void dma_set_double_buffer_mode(DMA_DBUFMODE_t dbufmode)
+{
+	irqflags_t flags = cpu_irq_save();
+	DMA.CTRL = (DMA.CTRL & ~DMA_DBUFMODE_gm) | dbufmode;
+	cpu_irq_restore(flags);
+}
+
+//@}
+
+//! \name DMA channel management
+//@{
+
+void dma_channel_write_config(dma_channel_num_t num,
+		struct dma_channel_config *config);
+void dma_set_callback(dma_channel_num_t num, dma_callback_t callback);
+enum dma_channel_status dma_get_channel_status(dma_channel_num_t num);
+
+/**
+ * \brief Enable DMA channel
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline void dma_channel_enable(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+	irqflags_t flags = cpu_irq_save();
+	channel->CTRLA |= DMA_CH_ENABLE_bm;
+	cpu_irq_restore(flags);
+}
+
+/**
+ * \brief Disable DMA channel
+ *
+ * Any transfer in progress is completed before the channel stops.
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline void dma_channel_disable(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+	irqflags_t flags = cpu_irq_save();
+	channel->CTRLA &= ~DMA_CH_ENABLE_bm;
+	cpu_irq_restore(flags);
+}
+
+/**
+ * \brief Check if DMA channel is enabled
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline bool dma_channel_is_enabled(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+
+	return (channel->CTRLA & DMA_CH_ENABLE_bm);
+}
+
+/**
+ * \brief Check if DMA channel is busy or has a transfer pending
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline bool dma_channel_is_busy(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+
+	return (channel->CTRLB & (DMA_CH_CHBUSY_bm | DMA_CH_CHPEND_bm));
+}
+
+/**
+ * \brief Request a transfer by software
+ *
+ * \param num DMA channel number 0 to 3.
+ */
+static inline void dma_channel_trigger_block_transfer(dma_channel_num_t num)
+{
+	DMA_CH_t *channel = dma_get_channel_address_from_num(num);
+	irqflags_t flags = cpu_irq_save();
+	channel->CTRLA |= DMA_CH_TRFREQ_bm;
+	cpu_irq_restore(flags);
+}
+
+//@}
+
+//! \name DMA channel configuration
+//@{
+
+/**
+ * \brief Set burst length
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param burst_length Bytes moved for each trigger, for example
+ * \c DMA_CH_BURSTLEN_2BYTE_gc .
+ */
+static inline void dma_channel_set_burst_length(
+		struct dma_channel_config *config, DMA_CH_BURSTLEN_t burst_length)
+{
+	config->ctrla &= ~DMA_CH_BURSTLEN_gm;
+	config->ctrla |= burst_length;
+}
+
+/**
+ * \brief Enable single shot mode, one burst for each trigger
+ *
+ * \param config Pointer to DMA channel configuration.
+ */
+static inline void dma_channel_set_single_shot(
+		struct dma_channel_config *config)
+{
+	config->ctrla |= DMA_CH_SINGLE_bm;
+}
+
+/**
+ * \brief Disable single shot mode, one block for each trigger
+ *
+ * \param config Pointer to DMA channel configuration.
+ */
+static inline void dma_channel_unset_single_shot(
+		struct dma_channel_config *config)
+{
+	config->ctrla &= ~DMA_CH_SINGLE_bm;
+}
+
+/**
+ * \brief Enable repeat mode
+ *
+ * The block transfer is repeated the number of times set with
+ * \ref dma_channel_set_repeats , zero repeats forever.
+ *
+ * \param config Pointer to DMA channel configuration.
+ */
+static inline void dma_channel_set_repeat(struct dma_channel_config *config)
+{
+	config->ctrla |= DMA_CH_REPEAT_bm;
+}
+
+/**
+ * \brief Disable repeat mode
+ *
+ * \param config Pointer to DMA channel configuration.
+ */
+static inline void dma_channel_unset_repeat(struct dma_channel_config *config)
+{
+	config->ctrla &= ~DMA_CH_REPEAT_bm;
+}
+
+/**
+ * \brief Set number of block repeats
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param repeats Number of blocks, 0 for unlimited.
+ */
+static inline void dma_channel_set_repeats(struct dma_channel_config *config,
+		uint8_t repeats)
+{
+	config->repcnt = repeats;
+}
+
+/**
+ * \brief Set transfer complete and error interrupt level
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param level Interrupt level.
+ */
+static inline void dma_channel_set_interrupt_level(
+		struct dma_channel_config *config, enum dma_int_level_t level)
+{
+	config->ctrlb &= ~(DMA_CH_ERRINTLVL_gm | DMA_CH_TRNINTLVL_gm);
+	config->ctrlb |= (level << DMA_CH_ERRINTLVL_gp) |
+			(level << DMA_CH_TRNINTLVL_gp);
+}
+
+/**
+ * \brief Set source address reload mode
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param mode Reload mode, for example \c DMA_CH_SRCRELOAD_BURST_gc .
+ */
+static inline void dma_channel_set_src_reload_mode(
+		struct dma_channel_config *config, DMA_CH_SRCRELOAD_t mode)
+{
+	config->addrctrl &= ~DMA_CH_SRCRELOAD_gm;
+	config->addrctrl |= mode;
+}
+
+/**
+ * \brief Set source address direction mode
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param mode Direction mode, for example \c DMA_CH_SRCDIR_INC_gc .
+ */
+static inline void dma_channel_set_src_dir_mode(
+		struct dma_channel_config *config, DMA_CH_SRCDIR_t mode)
+{
+	config->addrctrl &= ~DMA_CH_SRCDIR_gm;
+	config->addrctrl |= mode;
+}
+
+/**
+ * \brief Set destination address reload mode
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param mode Reload mode, for example \c DMA_CH_DESTRELOAD_BLOCK_gc .
+ */
+static inline void dma_channel_set_dest_reload_mode(
+		struct dma_channel_config *config, DMA_CH_DESTRELOAD_t mode)
+{
+	config->addrctrl &= ~DMA_CH_DESTRELOAD_gm;
+	config->addrctrl |= mode;
+}
+
+/**
+ * \brief Set destination address direction mode
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param mode Direction mode, for example \c DMA_CH_DESTDIR_INC_gc .
+ */
+static inline void dma_channel_set_dest_dir_mode(
+		struct dma_channel_config *config, DMA_CH_DESTDIR_t mode)
+{
+	config->addrctrl &= ~DMA_CH_DESTDIR_gm;
+	config->addrctrl |= mode;
+}
+
+/**
+ * \brief Set trigger source
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param source Trigger source, for example \c DMA_CH_TRIGSRC_ADCA_CH4_gc .
+ */
+static inline void dma_channel_set_trigger_source(
+		struct dma_channel_config *config, DMA_CH_TRIGSRC_t source)
+{
+	config->trigsrc = source;
+}
+
+/**
+ * \brief Set number of bytes in each block
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param count Bytes in block, 0 for 65536.
+ */
+static inline void dma_channel_set_transfer_count(
+		struct dma_channel_config *config, uint16_t count)
+{
+	config->trfcnt = count;
+}
+
+/**
+ * \brief Set 16 bit source address
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param address Source address in data memory.
+ */
+static inline void dma_channel_set_source_address(
+		struct dma_channel_config *config, uint16_t address)
+{
+	config->srcaddr = address;
+}
+
+/**
+ * \brief Set 16 bit destination address
+ *
+ * \param config Pointer to DMA channel configuration.
+ * \param address Destination address in data memory.
+ */
+static inline void dma_channel_set_destination_address(
+		struct dma_channel_config *config, uint16_t address)
+{
+	config->destaddr = address;
+}
+
+//@}
+
+//! @}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DMA_H */
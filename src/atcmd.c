@@ -0,0 +1,201 @@
+/**
+ * \file atcmd.c
+ * \brief Queued AT commands to the GainSpan module
+ *
+ * Sends AT commands one at a time from a queue and matches the response lines
+ * without waiting, so a slow module never stops the main loop.
+ *
+ * Additional information can be found in the [AT Command Guide](\ref AtCommandGuide) page.
+ *
+ */
+
+/**
+ * \page AtCommandGuide AT Command Guide
+ *
+ * Operation
+ * - atcmd_queue() adds a command with its timeout and callback, up to \ref ATCMD_QUEUE_SIZE
+ * - atcmd_tick() is called from the main loop, it sends the next command once the last has finished
+ *   and counts down the timeout of the command being answered, one count for each pass of about 1 ms
+ * - gainspan_RXdata() passes every character received outside escape sequences to atcmd_rx(),
+ *   so UDP data keeps being received while a command is answered
+ * - Lines are ended by <CR> or <LF>, characters below space are dropped and lines are cut to
+ *   \ref HARDWARE_BUFSIZESML - 1 characters
+ *
+ * Response matching
+ * - `OK` ends the command with \ref ATCMD_RESULT_OK
+ * - A line starting `ERROR` ends it with \ref ATCMD_RESULT_ERROR
+ * - The echo of the command is skipped
+ * - Any other line is passed to the callback with \ref ATCMD_RESULT_DATA
+ * - No end before the timeout gives \ref ATCMD_RESULT_TIMEOUT and the next command is sent
+ * - Lines while no command is waiting, such as association messages, are dropped
+ *
+ * The command text is not copied, it must stay unchanged until the callback has the result.
+ * The callback runs in the main loop and may queue further commands.
+ *
+ * Only the baud rate negotiation still waits for its responses, before the main loop starts,
+ * because the USART changes rate between its commands. Version query, flow control and bulk data are
+ * queued by the connect sequence.
+ *
+ * Defined in \ref atcmd.c
+ */
+
+
+#include <asf.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "gainspan.h"
+#include "atcmd.h"
+
+
+struct atcmd_entry
+{
+	const char* cmd;			/**< Command including <CR><LF> */
+	uint16_t timeout;			/**< Wait in ms for the result */
+	atcmd_callback_t done;		/**< Called with data lines and result, or NULL */
+};	/**< Queued command */
+
+
+static struct atcmd_entry atcmd_list[ATCMD_QUEUE_SIZE];	/**< Command queue, oldest at tail */
+static uint8_t atcmd_head;			/**< Next free entry */
+static uint8_t atcmd_tail;			/**< Command sent or next to send */
+static bool atcmd_active;			/**< Command at tail has been sent and waits for its result */
+static uint16_t atcmd_wait;			/**< Milliseconds left for the result */
+static char atcmd_line[HARDWARE_BUFSIZESML];	/**< Response line being received */
+static uint8_t atcmd_i;				/**< Characters in response line */
+
+
+
+/**
+ * \fn static void atcmd_finish(enum atcmd_results result)
+ * \brief Ends command at tail and calls its callback.
+ * \param result Result of command
+ */
+static void atcmd_finish(enum atcmd_results result)
+{
+	atcmd_callback_t done;
+
+	done = atcmd_list[atcmd_tail].done;
+	atcmd_active = false;
+	if (++atcmd_tail >= ATCMD_QUEUE_SIZE) atcmd_tail = 0;
+	// Queue updated first so the callback can add commands
+	if (done) done(result, atcmd_line);
+}
+
+
+
+/**
+ * \fn static bool atcmd_is_echo(void)
+ * \brief Checks if response line is the echo of the command being answered.
+ * \returns true if line matches command up to its <CR> or <LF>
+ */
+static bool atcmd_is_echo(void)
+{
+	const char* cmd;
+	uint8_t i;
+
+	cmd = atcmd_list[atcmd_tail].cmd;
+	for (i = 0; i < atcmd_i; i++)
+	{
+		if (cmd[i] != atcmd_line[i]) return false;
+	}
+	return ((cmd[i] == 13) || (cmd[i] == 10) || (cmd[i] == 0));
+}
+
+
+
+/**
+ * \fn static void atcmd_dispatch(void)
+ * \brief Matches complete response line.
+ */
+static void atcmd_dispatch(void)
+{
+	atcmd_line[atcmd_i] = 0;
+	if (!atcmd_active) return;
+	if (strcmp(atcmd_line, "OK") == 0) atcmd_finish(ATCMD_RESULT_OK);
+	else if (strncmp(atcmd_line, "ERROR", 5) == 0) atcmd_finish(ATCMD_RESULT_ERROR);
+	else if (!atcmd_is_echo() && atcmd_list[atcmd_tail].done) atcmd_list[atcmd_tail].done(ATCMD_RESULT_DATA, atcmd_line);
+}
+
+
+
+/**
+ * \fn bool atcmd_queue(const char* cmd, uint16_t timeout_ms, atcmd_callback_t done)
+ * \brief Adds command to queue.
+ * \param cmd Command including <CR><LF>, must not change until the callback has the result
+ * \param timeout_ms Wait in ms for OK or ERROR once sent
+ * \param done Called with each data line and the result, or NULL
+ * \returns false if queue is full
+ */
+bool atcmd_queue(const char* cmd, uint16_t timeout_ms, atcmd_callback_t done)
+{
+	uint8_t head;
+
+	head = atcmd_head + 1;
+	if (head >= ATCMD_QUEUE_SIZE) head = 0;
+	if (head == atcmd_tail) return false;
+	atcmd_list[atcmd_head].cmd = cmd;
+	atcmd_list[atcmd_head].timeout = timeout_ms;
+	atcmd_list[atcmd_head].done = done;
+	atcmd_head = head;
+	return true;
+}
+
+
+
+/**
+ * \fn bool atcmd_busy(void)
+ * \brief Returns true while any command is queued or waiting for its response.
+ */
+bool atcmd_busy(void)
+{
+	return (atcmd_head != atcmd_tail);
+}
+
+
+
+/**
+ * \fn void atcmd_tick(void)
+ * \brief Sends next command and times out response.
+ *
+ * Called from main loop about every millisecond.
+ */
+void atcmd_tick(void)
+{
+	if (atcmd_active)
+	{
+		if (atcmd_wait > 0) atcmd_wait--;
+		else
+		{
+			atcmd_i = 0;
+			atcmd_line[0] = 0;
+			atcmd_finish(ATCMD_RESULT_TIMEOUT);
+		}
+		return;
+	}
+	if (atcmd_head == atcmd_tail) return;
+	// Partial line belongs to no command
+	atcmd_i = 0;
+	atcmd_wait = atcmd_list[atcmd_tail].timeout;
+	atcmd_active = true;
+	gainspan_TX((char*)atcmd_list[atcmd_tail].cmd);
+}
+
+
+
+/**
+ * \fn void atcmd_rx(char ch)
+ * \brief Collects response text received outside escape sequences.
+ * \param ch Received character
+ *
+ * Called from gainspan_RXdata().
+ */
+void atcmd_rx(char ch)
+{
+	if ((ch == 13) || (ch == 10))
+	{	// Empty lines between responses are ignored
+		if (atcmd_i > 0) atcmd_dispatch();
+		atcmd_i = 0;
+	}
+	else if ((ch >= ' ') && (atcmd_i < HARDWARE_BUFSIZESML - 1)) atcmd_line[atcmd_i++] = ch;
+}
@@ -0,0 +1,55 @@
+/**
+ * \file atcmd.h
+ * \brief Handles queued AT commands to the GainSpan module
+ *
+ */
+
+#ifndef ATCMD_H
+#define ATCMD_H
+
+
+#define ATCMD_QUEUE_SIZE		8		/**< Commands waiting or being answered */
+
+
+enum atcmd_results
+{
+	ATCMD_RESULT_DATA,
+	ATCMD_RESULT_OK,
+	ATCMD_RESULT_ERROR,
+	ATCMD_RESULT_TIMEOUT
+};	/**< Callback reason enumerations, data is called for each response line before the result */
+
+
+typedef void (*atcmd_callback_t)(enum atcmd_results result, char* line);	/**< Called with each data line and then once with the result */
+
+
+
+/**
+ * \fn bool atcmd_queue(const char* cmd, uint16_t timeout_ms, atcmd_callback_t done)
+ * \brief Adds command to queue.
+ */
+bool atcmd_queue(const char* cmd, uint16_t timeout_ms, atcmd_callback_t done);
+
+
+/**
+ * \fn bool atcmd_busy(void)
+ * \brief Returns true while any command is queued or waiting for its response.
+ */
+bool atcmd_busy(void);
+
+
+/**
+ * \fn void atcmd_tick(void)
+ * \brief Sends next command and times out response.
+ */
+void atcmd_tick(void);
+
+
+/**
+ * \fn void atcmd_rx(char ch)
+ * \brief Collects response text received outside escape sequences.
+ */
+void atcmd_rx(char ch);
+
+
+#endif // ATCMD_H
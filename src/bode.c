@@ -0,0 +1,416 @@
+/**
+ * \file bode.c
+ * \brief Frequency response measurement
+ *
+ * Steps a DDS sine on one DAC channel through a list of frequencies, captures the input
+ * and output of the circuit under test on two ADC channels at a rate locked to the DAC
+ * points and sends only the gain and phase of each frequency, worked out on the device.
+ *
+ * Additional information can be found in the [Bode Guide](\ref BodeGuide) page.
+ *
+ */
+
+/**
+ * \page BodeGuide Bode Guide
+ *
+ * Operation
+ * - Frequencies are spaced evenly on a log scale from `<f1>` to `<f2>`
+ * - For each frequency the DAC point rate is set to \ref BODE_POINTS_PER_PERIOD times the frequency,
+ *   limited from \ref BODE_RATE_MIN to \ref BODE_RATE_MAX, and the DDS sine is started on `<dac>`
+ * - The sampler runs timed sweeps at the same requested rate, so `TCC1` has the same period as `TCC0`
+ *   and each sweep keeps the same place in the sine
+ * - The trigger waits \ref BODE_SETTLE_PERIODS periods for the circuit to settle, then keeps a block of
+ *   whole periods, as many as fit the trigger ring
+ * - The main loop removes the mean of each channel and runs a Goertzel filter at the DDS frequency
+ *   in fixed point, with the coefficients from the DDS sine table
+ * - Gain and phase are the ratio of the output to the input result, found with CORDIC, so the DAC
+ *   amplitude and the start of the block do not matter
+ * - The phase is corrected for `<out>` being converted one ADC clock per channel after `<in>`
+ * - Each result is sent when the GainSpan TX buffer is empty, then the next frequency starts
+ * - The sweep size, mode and rate from before the sweep are restored when it ends or is abandoned
+ *
+ * Gain uses the scale of each channel from the [Range Guide](\ref RangeGuide), so channels may have
+ * different gains, but auto ranging should be off while sweeping.
+ * The DDS amplitude and offset of `<dac>` set by `@dds` are used, see the [DDS Guide](\ref DdsGuide).
+ * Frequencies are limited to a quarter of the highest rate and to one period in the trigger ring at the lowest rate.
+ *
+ * UDP commands
+ * - `@bode<dac>,<in>,<out>,<f1>,<f2>,<n>` sweeps `<n>` frequencies from `<f1>` to `<f2>` mHz,
+ *   replies `BODE:<n>`, 0 when refused
+ * - `@bstop` abandons the sweep
+ *
+ * Results
+ * - `BODE<k>/<n>:<freq>:<gain>:<phase>` with frequency generated in mHz, gain in 1/1000 and phase in 0.01 degree
+ *
+ * Defined in \ref bode.c
+ */
+
+
+#include <asf.h>
+#include <stdio.h>
+
+#include "hardware.h"
+#include "gainspan.h"
+#include "sampler.h"
+#include "trigger.h"
+#include "capture.h"
+#include "range.h"
+#include "wave.h"
+#include "dds.h"
+#include "bode.h"
+
+
+static const int16_t bode_atan[] = {4500, 2657, 1404, 713, 358, 179, 90, 45, 22, 11, 6, 3, 1, 1};	/**< CORDIC angles atan(2^-i) in 0.01 degree */
+
+static uint8_t bode_dac;		/**< DAC channel of stimulus */
+static uint8_t bode_in;			/**< ADC channel of circuit input */
+static uint8_t bode_out;		/**< ADC channel of circuit output */
+static uint8_t bode_n;			/**< Frequencies in sweep */
+static uint8_t bode_k;			/**< Current frequency */
+static uint32_t bode_f1;		/**< First frequency in mHz */
+static uint32_t bode_ratio;		/**< Ratio of each frequency to the one before, 16 fraction bits */
+static uint32_t bode_freq;		/**< Current frequency generated in mHz */
+static uint32_t bode_step;		/**< Current frequency as phase step of one sweep, a full period is 2^32 */
+static uint16_t bode_len;		/**< Sweeps in block */
+static uint32_t bode_gain;		/**< Result gain in 1/1000 */
+static int16_t bode_phase;		/**< Result phase in 0.01 degree */
+
+
+
+/**
+ * \fn static uint32_t bode_pow(uint32_t r, uint8_t e)
+ * \brief Raises ratio to a power.
+ * \param r Ratio with 16 fraction bits
+ * \param e Power
+ * \returns Result with 16 fraction bits, 0xFFFFFFFF when too large
+ */
+static uint32_t bode_pow(uint32_t r, uint8_t e)
+{
+	uint64_t val;
+
+	val = 1UL << 16;
+	while (e-- > 0)
+	{
+		val = (val * r) >> 16;
+		if (val > 0xFFFFFFFFUL) return 0xFFFFFFFFUL;
+	}
+	return val;
+}
+
+
+
+/**
+ * \fn static int16_t bode_cordic(int32_t x, int32_t y, uint32_t* mag)
+ * \brief Finds angle and magnitude of vector.
+ * \param x Real part, less than 2^26
+ * \param y Imaginary part, less than 2^26
+ * \param mag Where to put magnitude, 1.647 times too large
+ * \returns Angle in 0.01 degree, -18000 to 18000
+ */
+static int16_t bode_cordic(int32_t x, int32_t y, uint32_t* mag)
+{
+	int32_t t;
+	int16_t angle;
+	uint8_t i;
+
+	// Rotate into right half first
+	angle = 0;
+	if (x < 0)
+	{
+		t = x;
+		if (y >= 0)
+		{
+			x = y;
+			y = -t;
+			angle = 9000;
+		}
+		else
+		{
+			x = -y;
+			y = t;
+			angle = -9000;
+		}
+	}
+
+	// Turn towards zero angle by smaller steps
+	for (i = 0; i < sizeof(bode_atan) / sizeof(bode_atan[0]); i++)
+	{
+		t = x;
+		if (y > 0)
+		{
+			x += y >> i;
+			y -= t >> i;
+			angle += bode_atan[i];
+		}
+		else
+		{
+			x -= y >> i;
+			y += t >> i;
+			angle -= bode_atan[i];
+		}
+	}
+	*mag = x;
+	return angle;
+}
+
+
+
+/**
+ * \fn static void bode_point(void)
+ * \brief Starts stimulus and block of current frequency.
+ */
+static void bode_point(void)
+{
+	uint32_t freq;
+	uint32_t rate;
+	uint32_t actual;
+	uint32_t settle;
+	uint16_t nmax;
+	uint16_t periods;
+
+	freq = ((uint64_t)bode_f1 * bode_pow(bode_ratio, bode_k)) >> 16;
+	rate = (freq / 1000) * BODE_POINTS_PER_PERIOD;
+	if (rate < BODE_RATE_MIN) rate = BODE_RATE_MIN;
+	if (rate > BODE_RATE_MAX) rate = BODE_RATE_MAX;
+	actual = wave_set_rate(rate);
+
+	// Input and output in each sweep, at least one whole period in the ring
+	capture_select((1 << bode_in) | (1 << bode_out));
+	nmax = TRIGGER_BUFSIZE / sampler_nr_of_ch;
+	if (freq > (actual * 250)) freq = actual * 250;
+	if (freq < ((actual * 1000 + nmax - 1) / nmax)) freq = (actual * 1000 + nmax - 1) / nmax;
+
+	dds_conf[bode_dac].shape = DDS_SHAPE_SINE;
+	dds_conf[bode_dac].freq = freq;
+	dds_conf[bode_dac].phase = 0;
+	dds_start(1 << bode_dac);
+	bode_freq = dds_get_freq(bode_dac);
+	bode_step = ((uint64_t)bode_freq << 32) / (actual * 1000);
+
+	// Block of whole periods
+	periods = ((uint64_t)nmax * bode_freq) / (actual * 1000);
+	if (periods == 0) periods = 1;
+	bode_len = (((uint64_t)periods * actual * 1000) + (bode_freq / 2)) / bode_freq;
+	if (bode_len > nmax) bode_len = nmax;
+	settle = ((uint64_t)BODE_SETTLE_PERIODS * actual * 1000) / bode_freq;
+	if (settle > 0xFFFF) settle = 0xFFFF;
+
+	trigger_conf.type = TRIGGER_TYPE_NONE;
+	trigger_conf.pre = 0;
+	trigger_conf.holdoff = settle;
+	trigger_conf.length = bode_len;
+	// Same requested rate as the DAC gives the same timer period
+	sampler_start(SAMPLER_MODE_TIMED, rate);
+	trigger_arm();
+}
+
+
+
+/**
+ * \fn static void bode_measure(void)
+ * \brief Works out gain and phase from the block of current frequency.
+ */
+static void bode_measure(void)
+{
+	struct adc_config adc_conf;
+	uint16_t sweep[SAMPLER_NR_OF_CHANNELS];
+	uint8_t chan[2];
+	int32_t mean[2];
+	int32_t s1[2];
+	int32_t s2[2];
+	int32_t re[2];
+	int32_t im[2];
+	uint32_t mag[2];
+	int16_t angle[2];
+	int32_t s0;
+	int32_t phase;
+	int16_t c;
+	int16_t s;
+	uint64_t num;
+	uint64_t den;
+	uint32_t top;
+	uint16_t i;
+	uint8_t nch;
+	uint8_t j;
+
+	nch = sampler_nr_of_ch;
+	chan[0] = bode_in;
+	chan[1] = bode_out;
+
+	// Mean of each channel with 4 fraction bits
+	mean[0] = 0;
+	mean[1] = 0;
+	for (i = 0; i < bode_len; i++)
+	{
+		trigger_read(i * nch, sweep, nch);
+		for (j = 0; j < 2; j++) mean[j] += sweep[chan[j]];
+	}
+	for (j = 0; j < 2; j++) mean[j] = (mean[j] << 4) / bode_len;
+
+	// Goertzel filter, coefficient 2cos(w) with 14 fraction bits
+	c = dds_sin(bode_step + 0x40000000UL);
+	s = dds_sin(bode_step);
+	for (j = 0; j < 2; j++)
+	{
+		s1[j] = 0;
+		s2[j] = 0;
+	}
+	for (i = 0; i < bode_len; i++)
+	{
+		trigger_read(i * nch, sweep, nch);
+		for (j = 0; j < 2; j++)
+		{
+			s0 = (((int32_t)sweep[chan[j]] << 4) - mean[j]) + (int32_t)(((int64_t)c * s1[j]) >> 13) - s2[j];
+			s2[j] = s1[j];
+			s1[j] = s0;
+		}
+	}
+
+	// Both results scaled alike to fit CORDIC
+	top = 0;
+	for (j = 0; j < 2; j++)
+	{
+		re[j] = s1[j] - (int32_t)(((int64_t)c * s2[j]) >> 14);
+		im[j] = (int32_t)(((int64_t)s * s2[j]) >> 14);
+		top |= (re[j] < 0) ? -re[j] : re[j];
+		top |= (im[j] < 0) ? -im[j] : im[j];
+	}
+	while (top >= (1UL << 26))
+	{
+		top >>= 1;
+		for (j = 0; j < 2; j++)
+		{
+			re[j] >>= 1;
+			im[j] >>= 1;
+		}
+	}
+	for (j = 0; j < 2; j++) angle[j] = bode_cordic(re[j], im[j], &mag[j]);
+
+	// Ratio of input voltages
+	num = (uint64_t)mag[1] * range_scale_nv(bode_out) * 1000;
+	den = (uint64_t)mag[0] * range_scale_nv(bode_in);
+	if (den == 0) bode_gain = 0;
+	else if ((num / den) > 0xFFFFFFFFUL) bode_gain = 0xFFFFFFFFUL;
+	else bode_gain = num / den;
+
+	// Output converted later in the sweep looks ahead
+	adc_read_configuration(&ADCA, &adc_conf);
+	phase = (int32_t)angle[1] - angle[0];
+	phase -= ((int32_t)(36 * bode_freq) * ((int8_t)bode_out - (int8_t)bode_in)) / (int32_t)(sysclk_get_per_hz() / (4UL << adc_conf.prescaler));
+	while (phase > 18000) phase -= 36000;
+	while (phase <= -18000) phase += 36000;
+	bode_phase = phase;
+}
+
+
+
+/**
+ * \fn uint8_t bode_start(uint8_t dac, uint8_t in, uint8_t out, uint32_t f1, uint32_t f2, uint8_t n)
+ * \brief Starts frequency response sweep.
+ * \param dac DAC channel of stimulus, 0 or 1
+ * \param in ADC channel of circuit input
+ * \param out ADC channel of circuit output, not the same as `in`
+ * \param f1 First frequency in mHz
+ * \param f2 Last frequency in mHz, not lower than `f1`
+ * \param n Number of frequencies, 1 to \ref BODE_POINTS_MAX
+ * \returns Number of frequencies, 0 if refused
+ */
+uint8_t bode_start(uint8_t dac, uint8_t in, uint8_t out, uint32_t f1, uint32_t f2, uint8_t n)
+{
+	uint64_t target;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t mid;
+
+	bode_stop();
+	if ((dac >= WAVE_NR_OF_CHANNELS) || (in >= SAMPLER_NR_OF_CHANNELS) || (out >= SAMPLER_NR_OF_CHANNELS) || (in == out)) return 0;
+	if ((n == 0) || (n > BODE_POINTS_MAX) || (f1 == 0) || (f2 < f1)) return 0;
+
+	// Ratio to the power n - 1 is f2 / f1, found by halving
+	lo = 1UL << 16;
+	if (n > 1)
+	{
+		target = ((uint64_t)f2 << 16) / f1;
+		if (target > 0xFFFFFFFFUL) target = 0xFFFFFFFFUL;
+		hi = target;
+		while ((hi - lo) > 1)
+		{
+			mid = lo + ((hi - lo) / 2);
+			if (bode_pow(mid, n - 1) <= target) lo = mid;
+			else hi = mid;
+		}
+	}
+
+	bode_dac = dac;
+	bode_in = in;
+	bode_out = out;
+	bode_n = n;
+	bode_k = 0;
+	bode_f1 = f1;
+	bode_ratio = lo;
+	// Sweep size, mode and rate come back when the sweep ends
+	capture_save();
+	bode_point();
+	bode_state = BODE_STATE_MEASURING;
+	return n;
+}
+
+
+
+/**
+ * \fn void bode_stop(void)
+ * \brief Abandons sweep and stops stimulus.
+ *
+ * The sampler is restarted with the settings from before the sweep.
+ */
+void bode_stop(void)
+{
+	if (bode_state == BODE_STATE_IDLE) return;
+	if (bode_state == BODE_STATE_MEASURING) trigger_disarm();
+	wave_stop(bode_dac);
+	capture_restore();
+	bode_state = BODE_STATE_IDLE;
+}
+
+
+
+/**
+ * \fn void bode_tick(void)
+ * \brief Works out and sends each result.
+ *
+ * Called from main loop. Queues at most one datagram and only when the GainSpan
+ * TX buffer is empty.
+ */
+void bode_tick(void)
+{
+	char buf[40];
+
+	if (bode_state == BODE_STATE_MEASURING)
+	{	// Block frozen?
+		if (trigger_state == TRIGGER_STATE_DONE)
+		{
+			bode_measure();
+			bode_state = BODE_STATE_SENDING;
+		}
+		else if (trigger_state == TRIGGER_STATE_OFF) bode_stop();
+		return;
+	}
+	if (bode_state != BODE_STATE_SENDING) return;
+	if (gainspan_head_tx != gainspan_tail_tx) return;
+
+	sprintf(buf, "BODE%u/%u:%lu:%lu:%d", bode_k, bode_n, bode_freq, bode_gain, bode_phase);
+	gainspan_TXdata(buf);
+
+	bode_k++;
+	if (bode_k < bode_n)
+	{
+		bode_point();
+		bode_state = BODE_STATE_MEASURING;
+	}
+	else
+	{
+		wave_stop(bode_dac);
+		capture_restore();
+		bode_state = BODE_STATE_IDLE;
+	}
+}
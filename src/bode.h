@@ -0,0 +1,51 @@
+/**
+ * \file bode.h
+ * \brief Handles frequency response measurement
+ *
+ */
+
+#ifndef BODE_H
+#define BODE_H
+
+
+#define BODE_POINTS_MAX			32		/**< Most frequencies in one sweep */
+#define BODE_POINTS_PER_PERIOD	16		/**< Sample rate as multiple of the frequency when within limits */
+#define BODE_RATE_MIN			10		/**< Lowest sample rate in Hz */
+#define BODE_RATE_MAX			5000	/**< Highest sample rate in Hz, DAC and sampler interrupts share the CPU */
+#define BODE_SETTLE_PERIODS		2		/**< Periods of each frequency skipped before the block is kept */
+
+
+enum bode_states
+{
+	BODE_STATE_IDLE,
+	BODE_STATE_MEASURING,
+	BODE_STATE_SENDING
+};	/**< Sweep state enumerations */
+
+
+enum bode_states bode_state;	/**< Current sweep state */
+
+
+
+/**
+ * \fn uint8_t bode_start(uint8_t dac, uint8_t in, uint8_t out, uint32_t f1, uint32_t f2, uint8_t n)
+ * \brief Starts frequency response sweep.
+ */
+uint8_t bode_start(uint8_t dac, uint8_t in, uint8_t out, uint32_t f1, uint32_t f2, uint8_t n);
+
+
+/**
+ * \fn void bode_stop(void)
+ * \brief Abandons sweep and stops stimulus.
+ */
+void bode_stop(void);
+
+
+/**
+ * \fn void bode_tick(void)
+ * \brief Works out and sends each result. Called from main loop.
+ */
+void bode_tick(void);
+
+
+#endif // BODE_H
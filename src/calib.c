@@ -0,0 +1,164 @@
+/**
+ * \file calib.c
+ * \brief ADC calibration and offset/gain correction
+ *
+ * Loads the factory ADC calibration at boot and keeps offset and gain coefficients
+ * for each channel in EEPROM. The sampler corrects every result before it is cached,
+ * stored or checked by the trigger.
+ *
+ * Additional information can be found in the [Calibration Guide](\ref CalibrationGuide) page.
+ *
+ */
+
+/**
+ * \page CalibrationGuide Calibration Guide
+ *
+ * Factory calibration
+ * - `ADCACAL0` and `ADCACAL1` are read from the production signature row and written to `ADCA.CAL`
+ *
+ * Channel correction
+ * - `corrected = ((result - offset) * gain) / 32768`
+ * - `offset` is in 12 bit ADC counts and is scaled with the oversampling of the channel
+ * - `gain` of 32768 is 1.0, the largest gain is just under 2.0
+ * - Results are limited to the range of the channel resolution
+ * - While auto ranging the coefficients are not applied, results are only limited to the signed
+ *   full scale of 2047 (127 in 8 bit mode), see [Range Guide](\ref RangeGuide)
+ * - 8 bit results are scaled to 12 bits for the correction so the same coefficients apply
+ * - Coefficients are stored in EEPROM at \ref CALIB_EEPROM_ADDR with a marker, blank EEPROM gives offset 0 and gain 1.0
+ *
+ * UDP commands
+ * - `@cal<ch>` replies `CAL<ch>:<offset>:<gain>`
+ * - `@cal<ch>,<offset>,<gain>` sets coefficients of channel, replies `CAL<ch>:<offset>:<gain>`
+ * - `@calsave` writes coefficients of all channels to EEPROM, replies `CALSAVE`
+ * - `@calf` replies `CALF:<factory calibration>`
+ *
+ * Defined in \ref calib.c
+ */
+
+
+#include <asf.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "sampler.h"
+#include "range.h"
+#include "calib.h"
+
+
+struct calib_eeprom
+{
+	uint16_t magic;		/**< \ref CALIB_MAGIC when coefficients are valid */
+	struct calib_channel ch[SAMPLER_NR_OF_CHANNELS];	/**< Coefficients of each channel */
+};	/**< Layout of coefficients in EEPROM */
+
+
+
+/**
+ * \fn void calib_init(void)
+ * \brief Loads factory calibration and coefficients from EEPROM.
+ *
+ * Must be called after hardware_init() has configured the ADC.
+ */
+void calib_init(void)
+{
+	struct calib_eeprom stored;
+	uint8_t ch;
+
+	// Factory pipeline calibration
+	calib_factory = adc_get_calibration_data(ADC_CAL_ADCA);
+	ADCA.CAL = calib_factory;
+
+	// Channel coefficients, defaults if EEPROM is blank
+	nvm_eeprom_read_buffer(CALIB_EEPROM_ADDR, &stored, sizeof(stored));
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+	{
+		if (stored.magic == CALIB_MAGIC) calib[ch] = stored.ch[ch];
+		else
+		{
+			calib[ch].offset = 0;
+			calib[ch].gain = CALIB_GAIN_ONE;
+		}
+	}
+}
+
+
+
+/**
+ * \fn void calib_set(uint8_t ch, int16_t offset, uint16_t gain)
+ * \brief Sets correction coefficients of channel.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param offset Offset in 12 bit ADC counts
+ * \param gain Gain in 1/32768 units
+ *
+ * Coefficients are used at once but are only kept after calib_save().
+ */
+void calib_set(uint8_t ch, int16_t offset, uint16_t gain)
+{
+	irqflags_t flags;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return;
+	flags = cpu_irq_save();
+	calib[ch].offset = offset;
+	calib[ch].gain = gain;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void calib_save(void)
+ * \brief Writes coefficients of all channels to EEPROM.
+ *
+ * Waits for the EEPROM write to complete.
+ */
+void calib_save(void)
+{
+	struct calib_eeprom stored;
+	irqflags_t flags;
+
+	stored.magic = CALIB_MAGIC;
+	flags = cpu_irq_save();
+	memcpy(stored.ch, calib, sizeof(stored.ch));
+	cpu_irq_restore(flags);
+	nvm_eeprom_erase_and_write_buffer(CALIB_EEPROM_ADDR, &stored, sizeof(stored));
+}
+
+
+
+/**
+ * \fn uint16_t calib_apply(uint8_t ch, uint16_t val, uint8_t os)
+ * \brief Returns corrected result.
+ * \param ch Channel number
+ * \param val Result of channel
+ * \param os Oversampling of result, result has `sampler_bits` + os bits
+ * \returns Corrected result limited to `sampler_bits` + os bits
+ *
+ * Coefficients are for single ended results, signed results while auto ranging are only
+ * limited to their full scale. Called from the sampler interrupt.
+ */
+uint16_t calib_apply(uint8_t ch, uint16_t val, uint8_t os)
+{
+	int32_t diff;
+	uint32_t corr;
+	uint32_t max;
+	uint8_t shift;
+
+	if (range_auto)
+	{	// Signed mode, positive full scale is 2047 or 127
+		max = ((1UL << (sampler_bits - 1)) << os) - 1;
+		if (val > max) val = max;
+		return val;
+	}
+	if ((calib[ch].offset == 0) && (calib[ch].gain == CALIB_GAIN_ONE)) return val;
+
+	// Coefficients are in 12 bit counts
+	shift = 12 - sampler_bits;
+	diff = ((int32_t)val << shift) - ((int32_t)calib[ch].offset * (1L << os));
+	if (diff <= 0) return 0;
+	// 16 bit difference times gain fits unsigned 32 bits
+	if (diff > 0xFFFF) diff = 0xFFFF;
+	corr = ((uint32_t)diff * calib[ch].gain) >> 15;
+	max = (4096UL << os) - 1;
+	if (corr > max) corr = max;
+	return (uint16_t)(corr >> shift);
+}
@@ -0,0 +1,56 @@
+/**
+ * \file calib.h
+ * \brief Handles ADC offset and gain correction
+ *
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+
+#define CALIB_GAIN_ONE			32768	/**< Gain of 1.0, gain is in 1/32768 units */
+#define CALIB_EEPROM_ADDR		0		/**< EEPROM address of stored coefficients */
+#define CALIB_MAGIC				0xCA1B	/**< Marks valid coefficients in EEPROM */
+
+
+struct calib_channel
+{
+	int16_t offset;		/**< Offset in 12 bit ADC counts, subtracted before gain */
+	uint16_t gain;		/**< Gain in 1/32768 units */
+};	/**< Correction coefficients of one channel */
+
+
+struct calib_channel calib[SAMPLER_NR_OF_CHANNELS];	/**< Correction coefficients of each channel */
+uint16_t calib_factory;		/**< Factory ADCA pipeline calibration from production signature row */
+
+
+
+/**
+ * \fn void calib_init(void)
+ * \brief Loads factory calibration and coefficients from EEPROM.
+ */
+void calib_init(void);
+
+
+/**
+ * \fn void calib_set(uint8_t ch, int16_t offset, uint16_t gain)
+ * \brief Sets correction coefficients of channel.
+ */
+void calib_set(uint8_t ch, int16_t offset, uint16_t gain);
+
+
+/**
+ * \fn void calib_save(void)
+ * \brief Writes coefficients of all channels to EEPROM.
+ */
+void calib_save(void);
+
+
+/**
+ * \fn uint16_t calib_apply(uint8_t ch, uint16_t val, uint8_t os)
+ * \brief Returns corrected result. Called from sampling interrupt.
+ */
+uint16_t calib_apply(uint8_t ch, uint16_t val, uint8_t os);
+
+
+#endif // CALIB_H
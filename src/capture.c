@@ -0,0 +1,377 @@
+/**
+ * \file capture.c
+ * \brief Block capture of ADC channels sent in few datagrams
+ *
+ * Captures a number of sweeps at a requested rate into the trigger ring and sends
+ * the selected channels back packed as hex digits, as many samples in each datagram
+ * as the TX buffer allows.
+ *
+ * Additional information can be found in the [Capture Guide](\ref CaptureGuide) page.
+ *
+ */
+
+/**
+ * \page CaptureGuide Capture Guide
+ *
+ * Operation
+ * - The sampler is restarted in timed mode at the requested rate with sweeps up to the highest selected channel
+ * - The trigger is armed with type `n` (immediate), no pre trigger sweeps and a window of `<n>` sweeps
+ * - When the window is frozen it is sent by capture_tick() from the main loop
+ * - Each datagram is built in a frame buffer and sent by DMA, see the [GainSpan Interface Guide](\ref GainSpanInterfaceGuide)
+ * - The next datagram is built when the DMA callback has released the frame and the GainSpan TX buffer is empty
+ *
+ * The number of sweeps is limited to \ref TRIGGER_BUFSIZE divided by the sweep size,
+ * for example 256 with channel 0 only and 64 with channel 3 selected.
+ *
+ * The sweep size, mode and rate from before the capture are restored once the window is frozen
+ * or the capture is abandoned, so `@adc` reads all channels again while the window is sent.
+ * The frozen window is kept for `@tread`. Equivalent-time and interleaved modes are not
+ * restarted, the sampler is stopped instead. After `@il` the mode from before the burst is restored.
+ *
+ * UDP commands
+ * - `@cap<mask>,<n>,<rate>` captures `<n>` samples of each channel in hex `<mask>` at `<rate>` sweeps per second
+ * - `@capbin<0|1>` sends later datagrams as hex text or packed binary, replies `CAPBIN:<0|1>`
+ *
+ * Replies
+ * - `CAP<first>/<total>:<samples>` with up to \ref CAPTURE_DATAGRAM_CHARS characters of samples
+ * - `<first>` is the index of the first sample in the datagram, `<total>` the number of samples in the capture
+ * - Samples are 3 upper case hex digits, 4 when a selected channel is oversampled, 2 in 8 bit mode
+ * - Selected channels are in channel order for each sweep
+ * - With peak detect (`@peak`) sweeps alternate between lowest and highest of each bucket
+ * - The first datagram has `;<nV>` for each selected channel before the samples, the input
+ *   voltage of one count, see the [Range Guide](\ref RangeGuide)
+ *
+ * Packed binary
+ * - With \ref capture_binary set datagrams are GainSpan bulk data and start `CAPB` instead of `CAP`
+ * - The header up to `:` is the same text, the samples follow as bytes holding the same hex digits,
+ *   two digits in each byte high digit first
+ * - 3 digit samples take 3 bytes for each 2 samples, a last odd digit has 0 in the low half of its byte
+ * - A datagram holds twice the samples of a hex datagram for the same number of bytes
+ *
+ * `@il<ch>,<rate>` sends an interleaved burst of one pin the same way, as channel `<ch>` alone,
+ * see the [Sampler Guide](\ref SamplerGuide).
+ *
+ * `@timed`, `@dma` and `@free` return to sweeps of all channels.
+ *
+ * Defined in \ref capture.c
+ */
+
+
+#include <asf.h>
+#include <stdio.h>
+
+#include "hardware.h"
+#include "gainspan.h"
+#include "sampler.h"
+#include "trigger.h"
+#include "capture.h"
+#include "range.h"
+
+
+static uint8_t capture_mask;		/**< Channels sent */
+static uint8_t capture_nch;			/**< Sweep size of the window */
+static uint8_t capture_base;		/**< Channel of first sample in sweep, not 0 only for interleaved bursts */
+static uint8_t capture_nsel;		/**< Number of channels sent */
+static uint8_t capture_digits;		/**< Hex digits for each sample */
+static uint16_t capture_n;			/**< Sweeps in capture */
+static uint16_t capture_sweep;		/**< Next sweep to send */
+static uint16_t capture_sent;		/**< Samples already sent */
+static bool capture_saved;			/**< Sampler settings below are restored when the window is frozen */
+static enum sampler_modes capture_prev_mode;	/**< Sampler mode before the capture */
+static uint32_t capture_prev_rate;	/**< Sweep rate before the capture */
+static uint8_t capture_prev_nch;	/**< Sweep size before the capture */
+static char capture_frame[CAPTURE_FRAME_SIZE];	/**< Datagram being sent by DMA */
+static volatile bool capture_frame_busy;		/**< Frame owned by DMA until released */
+
+
+
+/**
+ * \fn static char* capture_pack(char* p, uint16_t val, uint8_t digits, bool* half)
+ * \brief Writes value as hex digits packed two in each byte.
+ * \param p Where to write
+ * \param val Value
+ * \param digits Number of digits
+ * \param half true if the byte before p has only its high digit, updated
+ * \returns Pointer after last byte started
+ */
+static char* capture_pack(char* p, uint16_t val, uint8_t digits, bool* half)
+{
+	uint8_t nibble;
+
+	while (digits-- > 0)
+	{
+		nibble = (val >> (digits * 4)) & 0x0F;
+		if (*half) p[-1] |= nibble;
+		else *p++ = nibble << 4;
+		*half = !*half;
+	}
+	return p;
+}
+
+
+
+/**
+ * \fn static char* capture_hex(char* p, uint16_t val, uint8_t digits)
+ * \brief Writes value as upper case hex digits.
+ * \param p Where to write
+ * \param val Value
+ * \param digits Number of digits
+ * \returns Pointer after last digit
+ */
+static char* capture_hex(char* p, uint16_t val, uint8_t digits)
+{
+	uint8_t nibble;
+
+	while (digits-- > 0)
+	{
+		nibble = (val >> (digits * 4)) & 0x0F;
+		*p++ = (nibble < 10) ? ('0' + nibble) : ('A' - 10 + nibble);
+	}
+	return p;
+}
+
+
+
+/**
+ * \fn void capture_select(uint8_t mask)
+ * \brief Selects channels sent and sets sweep size.
+ * \param mask Bit mask of channels, bit 0 for channel 0
+ *
+ * Sweeps go only as far as the highest selected channel. Takes effect when the
+ * sampler is next started. Call capture_save() first to have the sweep size restored.
+ */
+void capture_select(uint8_t mask)
+{
+	uint8_t ch;
+
+	mask &= (1 << SAMPLER_NR_OF_CHANNELS) - 1;
+	if (mask == 0) mask = 1;
+	capture_mask = mask;
+	capture_base = 0;
+
+	capture_nsel = 0;
+	capture_digits = (sampler_bits == 8) ? 2 : 3;
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+	{
+		if (mask & (1 << ch))
+		{
+			capture_nsel++;
+			sampler_nr_of_ch = ch + 1;
+			if (sampler_os[ch]) capture_digits = 4;
+		}
+	}
+	capture_nch = sampler_nr_of_ch;
+}
+
+
+
+/**
+ * \fn void capture_save(void)
+ * \brief Keeps sampler settings to restore when the capture window is frozen.
+ *
+ * Called before the capture changes the sweep size. A capture started while another
+ * is running keeps the settings from before the first.
+ */
+void capture_save(void)
+{
+	if (capture_saved) return;
+	capture_prev_mode = sampler_mode;
+	capture_prev_rate = sampler_rate;
+	capture_prev_nch = sampler_nr_of_ch;
+	capture_saved = true;
+}
+
+
+
+/**
+ * \fn void capture_restore(void)
+ * \brief Restarts sampler with the settings from before the capture.
+ *
+ * Nothing is changed if another command has set a different sweep size since.
+ */
+void capture_restore(void)
+{
+	enum sampler_modes mode;
+	bool frozen;
+
+	if (!capture_saved) return;
+	capture_saved = false;
+	if (sampler_nr_of_ch != capture_nch) return;
+
+	mode = capture_prev_mode;
+	if ((mode == SAMPLER_MODE_ETS) || (mode == SAMPLER_MODE_INTERLEAVED)) mode = SAMPLER_MODE_OFF;
+	// Restart would arm the trigger again and lose the window
+	frozen = (trigger_state == TRIGGER_STATE_DONE);
+	if (frozen) trigger_state = TRIGGER_STATE_OFF;
+	sampler_nr_of_ch = capture_prev_nch;
+	sampler_start(mode, capture_prev_rate);
+	if (frozen) trigger_state = TRIGGER_STATE_DONE;
+}
+
+
+
+/**
+ * \fn void capture_wait(void)
+ * \brief Sends trigger window when frozen.
+ *
+ * The trigger must already be armed with the window length. Any capture still
+ * being sent is abandoned.
+ */
+void capture_wait(void)
+{
+	capture_n = trigger_conf.length;
+	capture_state = CAPTURE_STATE_CAPTURING;
+}
+
+
+
+/**
+ * \fn void capture_start(uint8_t mask, uint16_t n, uint32_t rate)
+ * \brief Starts capture of samples from selected channels.
+ * \param mask Bit mask of channels, bit 0 for channel 0
+ * \param n Samples of each channel (limited by trigger ring)
+ * \param rate Sweep rate in Hz
+ */
+void capture_start(uint8_t mask, uint16_t n, uint32_t rate)
+{
+	capture_save();
+	capture_select(mask);
+
+	// Immediate trigger with window of n sweeps
+	trigger_conf.type = TRIGGER_TYPE_NONE;
+	trigger_conf.pre = 0;
+	trigger_conf.holdoff = 0;
+	trigger_conf.length = n;
+	sampler_start(SAMPLER_MODE_TIMED, rate);
+	trigger_arm();
+
+	capture_wait();
+}
+
+
+
+/**
+ * \fn void capture_start_interleaved(uint8_t ch, uint32_t rate)
+ * \brief Starts capture of an interleaved burst of one channel.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param rate Samples per second
+ */
+void capture_start_interleaved(uint8_t ch, uint32_t rate)
+{
+	if (ch >= SAMPLER_NR_OF_CHANNELS) ch = 0;
+	capture_save();
+	capture_mask = 1;
+	capture_nsel = 1;
+	capture_digits = (sampler_bits == 8) ? 2 : 3;
+	capture_base = ch;
+
+	// Whole burst in one window
+	trigger_conf.type = TRIGGER_TYPE_NONE;
+	trigger_conf.pre = 0;
+	trigger_conf.holdoff = 0;
+	trigger_conf.length = 0;
+	sampler_start_interleaved(ch, rate);
+	// Armed once sweeps are one result, the ring is first fed when the burst completes
+	capture_nch = 1;
+	trigger_arm();
+
+	capture_wait();
+}
+
+
+
+/**
+ * \fn static void capture_frame_done(void)
+ * \brief Releases frame buffer. Called from DMA interrupt.
+ */
+static void capture_frame_done(void)
+{
+	capture_frame_busy = false;
+}
+
+
+
+/**
+ * \fn void capture_tick(void)
+ * \brief Sends captured samples when ready.
+ *
+ * Called from main loop. Starts at most one datagram and only when the frame has been
+ * released and the GainSpan TX buffer is empty.
+ */
+void capture_tick(void)
+{
+	uint16_t sweep[SAMPLER_NR_OF_CHANNELS];
+	uint8_t nch;
+	uint8_t ch;
+	char* p;
+	char* data;
+	char* end;
+	uint8_t step;
+	bool half;
+
+	if (capture_state == CAPTURE_STATE_CAPTURING)
+	{	// Window frozen?
+		if (trigger_state == TRIGGER_STATE_DONE)
+		{
+			capture_sweep = 0;
+			capture_sent = 0;
+			capture_state = CAPTURE_STATE_SENDING;
+			capture_restore();
+		}
+		else if (trigger_state == TRIGGER_STATE_OFF)
+		{
+			capture_state = CAPTURE_STATE_IDLE;
+			capture_restore();
+		}
+		return;
+	}
+	if (capture_state != CAPTURE_STATE_SENDING) return;
+	// Previous datagram still being sent?
+	if (capture_frame_busy || gainspan_dma_busy || (gainspan_head_tx != gainspan_tail_tx)) return;
+	// Trigger rearmed by another command?
+	if (trigger_state != TRIGGER_STATE_DONE)
+	{
+		capture_state = CAPTURE_STATE_IDLE;
+		return;
+	}
+
+	nch = capture_nch;
+	step = capture_digits * capture_nsel;
+	if (capture_binary)
+	{	// Length is set once the samples are in
+		data = gainspan_TXbulk_start(capture_frame);
+		step = (step + 1) / 2;
+	}
+	else data = gainspan_TXdata_start(capture_frame);
+	p = data;
+	end = p + CAPTURE_DATAGRAM_CHARS + 16 - step;
+	p += sprintf(p, capture_binary ? "CAPB%u/%u" : "CAP%u/%u", capture_sent, capture_n * capture_nsel);
+	if (capture_sent == 0)
+	{	// Scale of each channel
+		for (ch = 0; ch < nch; ch++)
+		{
+			if (capture_mask & (1 << ch)) p += sprintf(p, ";%lu", range_scale_nv(ch + capture_base));
+		}
+	}
+	*p++ = ':';
+	half = false;
+	// Scale shortens the first datagram instead of making it longer
+	while ((capture_sweep < capture_n) && (p <= end))
+	{
+		trigger_read(capture_sweep * nch, sweep, nch);
+		for (ch = 0; ch < nch; ch++)
+		{
+			if (!(capture_mask & (1 << ch))) continue;
+			if (capture_binary) p = capture_pack(p, sweep[ch], capture_digits, &half);
+			else p = capture_hex(p, sweep[ch], capture_digits);
+		}
+		capture_sent += capture_nsel;
+		capture_sweep++;
+	}
+	if (capture_binary) gainspan_TXbulk_length(data, p - data);
+	else p = gainspan_TXdata_end(p);
+	capture_frame_busy = true;
+	gainspan_TXdma(capture_frame, p - capture_frame, capture_frame_done);
+
+	if (capture_sweep >= capture_n) capture_state = CAPTURE_STATE_IDLE;
+}
@@ -0,0 +1,77 @@
+/**
+ * \file capture.h
+ * \brief Handles block capture
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+
+#define CAPTURE_DATAGRAM_CHARS	256		/**< Most sample characters in each datagram */
+#define CAPTURE_FRAME_SIZE		(CAPTURE_DATAGRAM_CHARS + 88)	/**< Frame buffer bytes, adds UDP header of up to 67 bytes, CAP header and trailer */
+
+
+enum capture_states
+{
+	CAPTURE_STATE_IDLE,
+	CAPTURE_STATE_CAPTURING,
+	CAPTURE_STATE_SENDING
+};	/**< Capture state enumerations */
+
+
+enum capture_states capture_state;	/**< Current capture state */
+bool capture_binary;				/**< Samples are sent packed two hex digits a byte as GainSpan bulk data */
+
+
+
+/**
+ * \fn void capture_start(uint8_t mask, uint16_t n, uint32_t rate)
+ * \brief Starts capture of samples from selected channels.
+ */
+void capture_start(uint8_t mask, uint16_t n, uint32_t rate);
+
+
+/**
+ * \fn void capture_select(uint8_t mask)
+ * \brief Selects channels sent and sets sweep size.
+ */
+void capture_select(uint8_t mask);
+
+
+/**
+ * \fn void capture_save(void)
+ * \brief Keeps sampler settings to restore when the capture window is frozen.
+ */
+void capture_save(void);
+
+
+/**
+ * \fn void capture_restore(void)
+ * \brief Restarts sampler with the settings from before the capture.
+ */
+void capture_restore(void);
+
+
+/**
+ * \fn void capture_wait(void)
+ * \brief Sends trigger window when frozen.
+ */
+void capture_wait(void);
+
+
+/**
+ * \fn void capture_start_interleaved(uint8_t ch, uint32_t rate)
+ * \brief Starts capture of an interleaved burst of one channel.
+ */
+void capture_start_interleaved(uint8_t ch, uint32_t rate);
+
+
+/**
+ * \fn void capture_tick(void)
+ * \brief Sends captured samples when ready. Called from main loop.
+ */
+void capture_tick(void);
+
+
+#endif // CAPTURE_H
@@ -42,9 +42,11 @@
 #define CONF_ADC_H
 
 /* Refer to the ADC driver for detailed documentation. */
-//#define CONFIG_ADC_CALLBACK_ENABLE
+// Sampler takes channel complete results through adc_set_callback()
+#define CONFIG_ADC_CALLBACK_ENABLE
 
-//#define CONFIG_ADC_CALLBACK_TYPE uint16_t
+// Signed results, the sampler runs signed mode while auto ranging
+#define CONFIG_ADC_CALLBACK_TYPE int16_t
 
 // define CONFIG_ADC_INTLVL        ADC_CH_INTLVL_LO_gc
 
@@ -41,8 +41,8 @@
 #ifndef CONF_CLOCK_H_INCLUDED
 #define CONF_CLOCK_H_INCLUDED
 
-#define CONFIG_SYSCLK_SOURCE          SYSCLK_SRC_RC2MHZ
-//#define CONFIG_SYSCLK_SOURCE        SYSCLK_SRC_RC32MHZ
+//#define CONFIG_SYSCLK_SOURCE        SYSCLK_SRC_RC2MHZ
+#define CONFIG_SYSCLK_SOURCE          SYSCLK_SRC_RC32MHZ
 //#define CONFIG_SYSCLK_SOURCE        SYSCLK_SRC_RC32KHZ
 //#define CONFIG_SYSCLK_SOURCE        SYSCLK_SRC_XOSC
 //#define CONFIG_SYSCLK_SOURCE        SYSCLK_SRC_PLL
@@ -51,6 +51,10 @@
 #define CONFIG_SYSCLK_PSADIV          SYSCLK_PSADIV_1
 #define CONFIG_SYSCLK_PSBCDIV         SYSCLK_PSBCDIV_1_1
 
+/* RC32MHz DFLL autocalibration against the internal 32 kHz oscillator is
+ * enabled by hardware_init(), not CONFIG_OSC_AUTOCAL, because this ASF
+ * version loads the 48 MHz USB compare value for that reference. */
+
 //#define CONFIG_PLL0_SOURCE          PLL_SRC_XOSC
 //#define CONFIG_PLL0_SOURCE          PLL_SRC_RC2MHZ
 //#define CONFIG_PLL0_SOURCE          PLL_SRC_RC32MHZ
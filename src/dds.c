@@ -0,0 +1,207 @@
+/**
+ * \file dds.c
+ * \brief Direct digital synthesis on the DAC channels
+ *
+ * Generates sine, triangle and square waves on each DACB channel from a 32 bit phase
+ * accumulator advanced at the DAC point rate, so the host does not stream any points.
+ *
+ * Additional information can be found in the [DDS Guide](\ref DdsGuide) page.
+ *
+ */
+
+/**
+ * \page DdsGuide DDS Guide
+ *
+ * Operation
+ * - Uses the `TCC0` event trigger and refill interrupt of the [Waveform Guide](\ref WaveGuide), the point rate is set with `@wrate`
+ * - Each channel adds its phase step to a 32 bit accumulator once for every point
+ * - Phase step is `frequency * 2^32 / rate`, so the frequency resolution is `rate / 2^32`, about 2.3 uHz at 10 kHz
+ * - Sine uses the top 8 bits of the accumulator to index a table of \ref DDS_TABLE_SIZE points in flash
+ * - Triangle uses the top 13 bits directly and square the top bit, so they need no table
+ * - The shape is scaled by `amplitude / 2048` in fixed point and added to `offset`, limited to the DAC range
+ * - Channels started together load their accumulators with their phase offsets in the same interrupt free
+ *   section, so the phase between them is exact and stays exact
+ *
+ * The frequency is limited to half the point rate, the generated frequency is rounded to the phase step.
+ * Changing the point rate needs the generator to be started again.
+ *
+ * UDP commands
+ * - `@dds<ch>,<s|t|q>,<freq>[,<phase>[,<amplitude>[,<offset>]]]` sets sine, triangle or square of `<freq>` mHz with
+ *   `<phase>` in 0.01 degree on channel and starts it again together with the other generating channel,
+ *   replies `DDS<ch>:<shape>:<freq generated>:<rate>`, shape 0 sine, 1 triangle, 2 square
+ * - `@wstop<ch>` stops channel
+ *
+ * Defined in \ref dds.c
+ */
+
+
+#include <asf.h>
+
+#include "hardware.h"
+#include "wave.h"
+#include "dds.h"
+
+
+PROGMEM_DECLARE(uint16_t, dds_sine[DDS_TABLE_SIZE]) = {
+	2048, 2098, 2148, 2199, 2249, 2299, 2348, 2398, 2447, 2497, 2545, 2594, 2642, 2690, 2738, 2785,
+	2831, 2878, 2923, 2968, 3013, 3057, 3100, 3143, 3185, 3227, 3267, 3307, 3347, 3385, 3423, 3459,
+	3495, 3531, 3565, 3598, 3630, 3662, 3692, 3722, 3750, 3777, 3804, 3829, 3853, 3876, 3898, 3919,
+	3939, 3958, 3975, 3992, 4007, 4021, 4034, 4045, 4056, 4065, 4073, 4080, 4085, 4089, 4093, 4094,
+	4095, 4094, 4093, 4089, 4085, 4080, 4073, 4065, 4056, 4045, 4034, 4021, 4007, 3992, 3975, 3958,
+	3939, 3919, 3898, 3876, 3853, 3829, 3804, 3777, 3750, 3722, 3692, 3662, 3630, 3598, 3565, 3531,
+	3495, 3459, 3423, 3385, 3347, 3307, 3267, 3227, 3185, 3143, 3100, 3057, 3013, 2968, 2923, 2878,
+	2831, 2785, 2738, 2690, 2642, 2594, 2545, 2497, 2447, 2398, 2348, 2299, 2249, 2199, 2148, 2098,
+	2048, 1998, 1948, 1897, 1847, 1797, 1748, 1698, 1649, 1599, 1551, 1502, 1454, 1406, 1358, 1311,
+	1265, 1218, 1173, 1128, 1083, 1039, 996, 953, 911, 869, 829, 789, 749, 711, 673, 637,
+	601, 565, 531, 498, 466, 434, 404, 374, 346, 319, 292, 267, 243, 220, 198, 177,
+	157, 138, 121, 104, 89, 75, 62, 51, 40, 31, 23, 16, 11, 7, 3, 2,
+	1, 2, 3, 7, 11, 16, 23, 31, 40, 51, 62, 75, 89, 104, 121, 138,
+	157, 177, 198, 220, 243, 267, 292, 319, 346, 374, 404, 434, 466, 498, 531, 565,
+	601, 637, 673, 711, 749, 789, 829, 869, 911, 953, 996, 1039, 1083, 1128, 1173, 1218,
+	1265, 1311, 1358, 1406, 1454, 1502, 1551, 1599, 1649, 1698, 1748, 1797, 1847, 1897, 1948, 1998
+};	/**< One period of sine in 12 bit DAC counts */
+
+static uint32_t dds_acc[WAVE_NR_OF_CHANNELS];	/**< Phase accumulators, a full period is 2^32 */
+static uint32_t dds_step[WAVE_NR_OF_CHANNELS];	/**< Phase added for each point */
+
+
+
+/**
+ * \fn void dds_init(void)
+ * \brief Sets default generator settings.
+ *
+ * Full range sine of 10 Hz on both channels, not started.
+ */
+void dds_init(void)
+{
+	uint8_t ch;
+
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		dds_conf[ch].shape = DDS_SHAPE_SINE;
+		dds_conf[ch].freq = 10000;
+		dds_conf[ch].phase = 0;
+		dds_conf[ch].amplitude = DDS_AMPLITUDE_FULL;
+		dds_conf[ch].offset = 2048;
+		dds_acc[ch] = 0;
+		dds_step[ch] = 0;
+	}
+}
+
+
+
+/**
+ * \fn void dds_start(uint8_t mask)
+ * \brief Starts generators of channels together.
+ * \param mask Bit mask of channels, bit 0 for channel 0
+ *
+ * Phase steps are worked out from the settings in `dds_conf` and the current point rate.
+ * All channels in the mask start from their phase offsets at the same timer overflow.
+ */
+void dds_start(uint8_t mask)
+{
+	irqflags_t flags;
+	uint32_t step[WAVE_NR_OF_CHANNELS];
+	uint8_t ch;
+
+	// Worked out before the interrupt free section, 64 bit division is slow
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (dds_conf[ch].freq > (wave_rate * 500)) dds_conf[ch].freq = wave_rate * 500;
+		if (dds_conf[ch].phase >= DDS_PHASE_FULL) dds_conf[ch].phase %= DDS_PHASE_FULL;
+		step[ch] = ((uint64_t)dds_conf[ch].freq << 32) / ((uint64_t)wave_rate * 1000);
+	}
+
+	// No overflow may advance a channel between loading its phase and starting it
+	flags = cpu_irq_save();
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (mask & (1 << ch))
+		{
+			dds_step[ch] = step[ch];
+			dds_acc[ch] = ((uint64_t)dds_conf[ch].phase << 32) / DDS_PHASE_FULL;
+		}
+	}
+	wave_start_channels(mask, WAVE_MODE_DDS, 0);
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn uint32_t dds_get_freq(uint8_t ch)
+ * \brief Returns frequency generated after rounding to the phase step.
+ * \param ch DAC channel 0 or 1
+ * \returns Frequency in mHz, 0 if the channel has not been started
+ */
+uint32_t dds_get_freq(uint8_t ch)
+{
+	if (ch >= WAVE_NR_OF_CHANNELS) return 0;
+	return ((uint64_t)dds_step[ch] * wave_rate * 1000) >> 32;
+}
+
+
+
+/**
+ * \fn uint16_t dds_next(uint8_t ch)
+ * \brief Returns next point of channel and advances its phase.
+ * \param ch DAC channel 0 or 1
+ * \returns 12 bit DAC value
+ *
+ * Called from the DAC timer interrupt.
+ */
+uint16_t dds_next(uint8_t ch)
+{
+	uint32_t acc;
+	int16_t shape;
+	int32_t val;
+
+	acc = dds_acc[ch];
+	dds_acc[ch] = acc + dds_step[ch];
+
+	// Shape from -2048 to 2047
+	switch (dds_conf[ch].shape)
+	{
+		case DDS_SHAPE_TRIANGLE:
+			// Top 13 bits rise for half a period and fall for the other half
+			shape = acc >> 19;
+			if (shape >= 4096) shape = 8191 - shape;
+			shape -= 2048;
+			break;
+		case DDS_SHAPE_SQUARE:
+			shape = (acc & 0x80000000UL) ? -2048 : 2047;
+			break;
+		default:
+			shape = PROGMEM_READ_WORD(&dds_sine[acc >> 24]) - 2048;
+			break;
+	}
+
+	val = dds_conf[ch].offset + (((int32_t)shape * dds_conf[ch].amplitude) >> 11);
+	if (val < 0) val = 0;
+	if (val > 4095) val = 4095;
+	return (uint16_t)val;
+}
+
+
+
+/**
+ * \fn int16_t dds_sin(uint32_t phase)
+ * \brief Returns sine of phase from the sine table.
+ * \param phase Phase, a full period is 2^32
+ * \returns Sine scaled to 16384, interpolated between table points
+ *
+ * Cosine is the sine of `phase + 0x40000000`.
+ */
+int16_t dds_sin(uint32_t phase)
+{
+	int16_t a;
+	int16_t b;
+	int32_t val;
+	uint8_t i;
+
+	i = phase >> 24;
+	a = PROGMEM_READ_WORD(&dds_sine[i]) - 2048;
+	b = PROGMEM_READ_WORD(&dds_sine[(uint8_t)(i + 1)]) - 2048;
+	val = a + (((int32_t)(b - a) * (uint16_t)(phase >> 8)) >> 16);
+	return (val * 16384) / 2047;
+}
@@ -0,0 +1,73 @@
+/**
+ * \file dds.h
+ * \brief Handles direct digital synthesis on the DAC channels
+ *
+ */
+
+#ifndef DDS_H
+#define DDS_H
+
+
+#define DDS_TABLE_SIZE			256		/**< Points in one period of the sine table, indexed by the top 8 phase bits */
+#define DDS_AMPLITUDE_FULL		2048	/**< Amplitude giving full DAC range */
+#define DDS_PHASE_FULL			36000	/**< Phase offset of one period, 0.01 degree units */
+
+
+enum dds_shapes
+{
+	DDS_SHAPE_SINE,
+	DDS_SHAPE_TRIANGLE,
+	DDS_SHAPE_SQUARE
+};	/**< Waveform shape enumerations */
+
+
+struct dds_config
+{
+	enum dds_shapes shape;	/**< Waveform shape */
+	uint32_t freq;			/**< Frequency in mHz */
+	uint16_t phase;			/**< Phase offset in 0.01 degree, applied when started */
+	uint16_t amplitude;		/**< Peak amplitude in DAC counts, \ref DDS_AMPLITUDE_FULL for full range */
+	uint16_t offset;		/**< Centre in DAC counts */
+};	/**< Generator settings of one DAC channel */
+
+
+struct dds_config dds_conf[WAVE_NR_OF_CHANNELS];	/**< Generator settings of each DAC channel */
+
+
+
+/**
+ * \fn void dds_init(void)
+ * \brief Sets default generator settings.
+ */
+void dds_init(void);
+
+
+/**
+ * \fn void dds_start(uint8_t mask)
+ * \brief Starts generators of channels together.
+ */
+void dds_start(uint8_t mask);
+
+
+/**
+ * \fn uint32_t dds_get_freq(uint8_t ch)
+ * \brief Returns frequency generated after rounding to the phase step, in mHz.
+ */
+uint32_t dds_get_freq(uint8_t ch);
+
+
+/**
+ * \fn uint16_t dds_next(uint8_t ch)
+ * \brief Returns next point of channel. Called from DAC timer interrupt.
+ */
+uint16_t dds_next(uint8_t ch);
+
+
+/**
+ * \fn int16_t dds_sin(uint32_t phase)
+ * \brief Returns sine of phase scaled to 16384, a full period is 2^32.
+ */
+int16_t dds_sin(uint32_t phase);
+
+
+#endif // DDS_H
@@ -0,0 +1,195 @@
+/**
+ * \file ets.c
+ * \brief Equivalent-time sampling of repetitive signals
+ *
+ * Builds a record with a sample spacing shorter than the ADC can convert by taking
+ * one sweep for each repetition of the signal, each time a little later after the
+ * trigger edge.
+ *
+ * Additional information can be found in the [Equivalent-Time Guide](\ref EtsGuide) page.
+ *
+ */
+
+/**
+ * \page EtsGuide Equivalent-Time Guide
+ *
+ * Operation
+ * - Analog comparator AC0 of `ACA` compares the trigger channel pin with a fraction of VCC
+ * - The rising edge of the comparator output is routed through event channel 1 and restarts `TCC1`
+ * - The restart is done by hardware so the sweep delay does not depend on interrupt latency
+ * - The comparator interrupt then routes `TCC1` compare A to the ADC, one sweep starts when the count reaches the delay
+ * - After the sweep the delay is increased by the sample period divided by `<ratio>` and the comparator is armed again
+ * - Sweeps are passed to the trigger ring in order so the record is already interleaved
+ *
+ * The first sweep is taken \ref ETS_MIN_DELAY timer ticks after the edge. If the comparator interrupt
+ * is delayed past that point the repetition is skipped.
+ *
+ * Oversampling and peak detect are turned off because consecutive sweeps are from different repetitions.
+ * Only rising edges are supported, the comparator level is `VCC * (scale + 1) / 64` converted from
+ * ADC counts so it is approximate.
+ *
+ * UDP commands
+ * - `@ets<mask>,<ch>,<level>,<points>,<rate>,<ratio>` records `<points>` sweeps at `<rate>` times `<ratio>`
+ *   sweeps per second triggered by channel `<ch>` rising through `<level>`, replies `ETS:<points>:<equivalent rate>`
+ * - A missing or out of range field replies `ETS:0:0` and leaves the sampler running as it was
+ * - The record is sent as `CAP` datagrams of the channels in hex `<mask>` when complete, see the [Capture Guide](\ref CaptureGuide)
+ *
+ * Defined in \ref ets.c
+ */
+
+
+#include <asf.h>
+
+#include "hardware.h"
+#include "sampler.h"
+#include "trigger.h"
+#include "ets.h"
+
+
+static uint16_t ets_step;		/**< Timer ticks added to delay after each sweep */
+static uint16_t ets_points;		/**< Sweeps in record */
+static uint16_t ets_i;			/**< Sweeps taken */
+
+
+
+/**
+ * \fn static void ets_arm(void)
+ * \brief Routes comparator edge to timer restart and enables comparator interrupt.
+ *
+ * The event is routed before the interrupt is enabled so an edge in between only
+ * restarts the timer again on the next edge.
+ */
+static void ets_arm(void)
+{
+	ets_state = ETS_STATE_WAITING;
+	EVSYS.CH1MUX = EVSYS_CHMUX_ACA_CH0_gc;
+	ACA.STATUS = AC_AC0IF_bm;
+	ACA.AC0CTRL = (ACA.AC0CTRL & ~AC_INTLVL_gm) | AC_INTLVL_HI_gc;
+}
+
+
+
+/**
+ * \fn void ets_start(uint8_t ch, uint16_t level, uint16_t points, uint32_t rate, uint8_t ratio)
+ * \brief Starts equivalent-time record of sweeps.
+ * \param ch Trigger channel 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param level Trigger level in ADC counts
+ * \param points Sweeps in record (limited by trigger ring and timer range)
+ * \param rate Real sweep rate in Hz, sets the sample period
+ * \param ratio Steps in each sample period
+ *
+ * Sweep size in `sampler_nr_of_ch` must be set before calling.
+ */
+void ets_start(uint8_t ch, uint16_t level, uint16_t points, uint32_t rate, uint8_t ratio)
+{
+	uint32_t timer_hz;
+	uint32_t scale;
+	uint8_t i;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) ch = 0;
+	if (ratio == 0) ratio = 1;
+
+	// Consecutive sweeps are from different repetitions
+	sampler_set_peak(0);
+	for (i = 0; i < SAMPLER_NR_OF_CHANNELS; i++) sampler_set_oversampling(i, 0);
+	sampler_start(SAMPLER_MODE_ETS, rate);
+
+	// Step is a fraction of the sample period, delays must fit the timer
+	timer_hz = hardware_set_timer_rate(&SAMPLER_TIMER, sampler_rate);
+	ets_step = ((uint32_t)tc_read_period(&SAMPLER_TIMER) + 1) / ratio;
+	if (ets_step == 0) ets_step = 1;
+	if (points == 0) points = 1;
+	if (points > ((0xFFFEUL - ETS_MIN_DELAY) / ets_step) + 1) points = ((0xFFFEUL - ETS_MIN_DELAY) / ets_step) + 1;
+	ets_rate = timer_hz / ets_step;
+
+	// Timer only restarted by comparator, one compare match for each restart
+	tc_write_period(&SAMPLER_TIMER, 0xFFFF);
+	tc_write_cc(&SAMPLER_TIMER, TC_CCA, ETS_MIN_DELAY);
+	tc_enable_cc_channels(&SAMPLER_TIMER, TC_CCAEN);
+	tc_set_input_capture(&SAMPLER_TIMER, TC_EVSEL_CH1_gc, TC_EVACT_RESTART_gc);
+
+	// Record sweeps in order in trigger ring
+	trigger_conf.type = TRIGGER_TYPE_NONE;
+	trigger_conf.pre = 0;
+	trigger_conf.holdoff = 0;
+	trigger_conf.length = points;
+	trigger_arm();
+	ets_points = trigger_conf.length;
+	ets_i = 0;
+
+	// Comparator on channel pin against scaled VCC, ADC full scale is VCC/1.6
+	sysclk_enable_module(SYSCLK_PORT_A, SYSCLK_AC);
+	scale = (((uint32_t)level << (12 - sampler_bits)) * 10) >> 10;
+	if (scale > 0) scale--;
+	if (scale > 63) scale = 63;
+	ACA.CTRLB = scale;
+	ACA.AC0MUXCTRL = ((ch + 1) << AC_MUXPOS_gp) | AC_MUXNEG_SCALER_gc;
+	ACA.AC0CTRL = AC_INTMODE_RISING_gc | AC_HYSMODE_SMALL_gc | AC_ENABLE_bm;
+
+	ets_arm();
+}
+
+
+
+/**
+ * \fn void ets_stop(void)
+ * \brief Stops comparator and timer restarts.
+ *
+ * Called by sampler_stop(). A completed record stays in the trigger ring.
+ */
+void ets_stop(void)
+{
+	EVSYS.CH1MUX = EVSYS_CHMUX_OFF_gc;
+	ACA.AC0CTRL = 0;
+	tc_set_input_capture(&SAMPLER_TIMER, TC_EVSEL_OFF_gc, TC_EVACT_OFF_gc);
+	tc_disable_cc_channels(&SAMPLER_TIMER, TC_CCAEN);
+	if (ets_state != ETS_STATE_DONE) ets_state = ETS_STATE_OFF;
+}
+
+
+
+/**
+ * \fn void ets_sweep(void)
+ * \brief Moves to next delay after a sweep.
+ *
+ * Called from the sampler interrupt after the sweep has been stored.
+ */
+void ets_sweep(void)
+{
+	if (ets_state != ETS_STATE_SAMPLING) return;
+	EVSYS.CH0MUX = EVSYS_CHMUX_OFF_gc;
+
+	if (++ets_i >= ets_points)
+	{	// Record complete
+		ets_state = ETS_STATE_DONE;
+		ets_stop();
+		return;
+	}
+	tc_write_cc(&SAMPLER_TIMER, TC_CCA, ETS_MIN_DELAY + (ets_i * ets_step));
+	ets_arm();
+}
+
+
+
+/**
+ * \internal
+ * \brief Comparator edge, timer has already been restarted by the event
+ */
+ISR(ACA_AC0_vect)
+{
+	uint16_t cnt;
+
+	// No more restarts until this sweep is taken
+	EVSYS.CH1MUX = EVSYS_CHMUX_OFF_gc;
+	ACA.AC0CTRL &= ~AC_INTLVL_gm;
+
+	// Too late to catch compare match? Count is read first so the margin covers the write.
+	cnt = tc_read_count(&SAMPLER_TIMER);
+	if (((uint32_t)cnt + 8) >= tc_read_cc(&SAMPLER_TIMER, TC_CCA))
+	{
+		ets_arm();
+		return;
+	}
+	EVSYS.CH0MUX = EVSYS_CHMUX_TCC1_CCA_gc;
+	ets_state = ETS_STATE_SAMPLING;
+}
@@ -0,0 +1,50 @@
+/**
+ * \file ets.h
+ * \brief Handles equivalent-time sampling
+ *
+ */
+
+#ifndef ETS_H
+#define ETS_H
+
+
+#define ETS_EVCH				1		/**< Event channel routing comparator edge to timer restart */
+#define ETS_MIN_DELAY			64		/**< Timer ticks from trigger to first sweep, must exceed interrupt latency */
+
+
+enum ets_states
+{
+	ETS_STATE_OFF,
+	ETS_STATE_WAITING,
+	ETS_STATE_SAMPLING,
+	ETS_STATE_DONE
+};	/**< Equivalent-time sampling state enumerations */
+
+
+volatile enum ets_states ets_state;	/**< Current equivalent-time sampling state */
+uint32_t ets_rate;					/**< Equivalent sweep rate in Hz of current record */
+
+
+
+/**
+ * \fn void ets_start(uint8_t ch, uint16_t level, uint16_t points, uint32_t rate, uint8_t ratio)
+ * \brief Starts equivalent-time record of sweeps.
+ */
+void ets_start(uint8_t ch, uint16_t level, uint16_t points, uint32_t rate, uint8_t ratio);
+
+
+/**
+ * \fn void ets_stop(void)
+ * \brief Stops comparator and timer restarts.
+ */
+void ets_stop(void);
+
+
+/**
+ * \fn void ets_sweep(void)
+ * \brief Moves to next delay after a sweep. Called from sampling interrupt.
+ */
+void ets_sweep(void);
+
+
+#endif // ETS_H
@@ -11,7 +11,45 @@
 /**
  * \page GainSpanInterfaceGuide GainSpan Interface Guide
  * 
- * 
+ * Baud rate
+ * - The module starts at \ref USART_GAINSPAN_BAUDRATE, after the version query gainspan_negotiate_baud() raises it
+ * - Each rate from 460800 down to 115200 is requested with `ATB=<baud>` and checked with `AT` at the new rate
+ * - A rate the module accepts but does not answer at is undone with `ATB` at the default rate before the next is tried
+ * - The rate in use is in \ref gainspan_baud and is shown on the user port as `BAUD <baud>`
+ * - 460800 is the highest rate tried because every received byte costs an interrupt shared with the sampler
+ * - The user port stays at \ref USART_USER_BAUDRATE, GainSpan echo that does not fit is dropped
+ *
+ * DMA frames
+ * - gainspan_TXdma() hands a complete frame buffer to DMA channel \ref GAINSPAN_DMA_CH, which writes
+ *   it to USARTE0 DATA one byte for each data register empty request
+ * - The frame starts only when the TX buffer is empty, characters queued while it is sent follow it
+ * - The callback is called from the DMA interrupt once the last byte is in the USART and releases the buffer
+ * - UDP frames are built with gainspan_TXdata_start() and gainspan_TXdata_end() around the data
+ *
+ * Bulk data
+ * - ASCII UDP data `<ESC>U` ends at `<ESC>E`, so it cannot carry <ESC> or control bytes and
+ *   received characters below space are dropped
+ * - Bulk data `<ESC>Y<CID><IP>:<PORT>:<LENGTH><DATA>` carries any byte values, `LENGTH` is four
+ *   decimal digits and there is no trailer
+ * - gainspan_TXbulk() sends a buffer as bulk data, DMA frames use gainspan_TXbulk_start() and
+ *   set the length with gainspan_TXbulk_length() once the data is written
+ * - `AT+BDATA=1` is queued at bring-up so the module hands on received UDP data as
+ *   `<ESC>y<CID><IP> <PORT>\t<LENGTH><DATA>`, shown on the user port as `BULK ON`
+ * - gainspan_RXdata() takes both forms and sets \ref gainspan_rxdata_len, bulk data beyond
+ *   \ref HARDWARE_BUFSIZESML - 1 bytes is dropped
+ *
+ * Flow control
+ * - `CTS0` (PE1) is the module `RTS`, `RTS0` (PD4) the module `CTS`, both low when ready, see [Hardware Pinouts](\ref HardwarePinouts)
+ * - `AT&R1` is queued once the baud rate is raised, gainspan_flow_enable() turns on flow control of the USART
+ *   when the module accepts it and drives CTS low, otherwise `AT&R0` turns it off again
+ * - `AT&K1` XON/XOFF is not used, it would take 0x11 and 0x13 in bulk data as flow control
+ * - While CTS is released the TX buffer interrupt stops itself and a DMA frame has its trigger turned off,
+ *   both restart from the CTS pin change interrupt
+ * - The RX interrupt releases RTS when \ref GAINSPAN_RTS_OFF_SPACE bytes or fewer are free and
+ *   user_tick() asserts it again once \ref GAINSPAN_RTS_ON_SPACE are free
+ * - TX writers wait for room instead of overwriting, so AT commands and escape sequences are never cut
+ * - A byte that waits more than \ref GAINSPAN_CTS_WAIT_MS for CTS is dropped and counted in \ref gainspan_tx_dropped,
+ *   later bytes are dropped at once until the buffer has room again
  *
  * Defined in \ref gainspan.c
  */
@@ -19,12 +57,22 @@
 
 #include <gpio.h>
 #include <asf.h>
+#include <stdio.h>
 #include <string.h>
 
 
+#include "conf_usart_serial.h"
 #include "hardware.h"
 #include "gainspan.h"
 #include "user.h"
+#include "atcmd.h"
+
+
+static const uint32_t gainspan_bauds[] = {460800, 230400, 115200};	/**< Baud rates tried by gainspan_negotiate_baud(), highest first */
+static gainspan_tx_callback_t gainspan_dma_done;	/**< Called when the DMA frame has been sent */
+static bool gainspan_tx_stalled;	/**< Module held CTS released, bytes are dropped while the TX buffer is full */
+static bool gainspan_rxesc_bulk;		/**< Escape sequence being received is <ESC><y> bulk data */
+static uint16_t gainspan_rxesc_len;		/**< Bulk data bytes still to be received */
 
 
 
@@ -55,13 +103,8 @@ void gainspan_TX(char* buf)
 	ch = buf[i++];
 	while(ch != 0)
 	{
-		gainspan_buf_tx[gainspan_head_tx++] = ch;
+		gainspan_TXchar(ch);
 		ch = buf[i++];
-		if (gainspan_head_tx >= HARDWARE_BUFSIZE) gainspan_head_tx = 0;
-		if (gainspan_head_tx == gainspan_tail_tx) 
-		{
-			if (++gainspan_tail_tx >= HARDWARE_BUFSIZE) gainspan_tail_tx = 0;
-		}
 	}
 }
 
@@ -81,13 +124,8 @@ void gainspan_TXparam(char* buf)
 	ch = buf[i++];
 	while((ch != 0) && (i <= HARDWARE_BUFSIZE))
 	{
-		gainspan_buf_tx[gainspan_head_tx++] = ch;
+		gainspan_TXchar(ch);
 		ch = buf[i++];
-		if (gainspan_head_tx >= HARDWARE_BUFSIZE) gainspan_head_tx = 0;
-		if (gainspan_head_tx == gainspan_tail_tx) 
-		{
-			if (++gainspan_tail_tx >= HARDWARE_BUFSIZE) gainspan_tail_tx = 0;
-		}
 	}
 }
 
@@ -95,16 +133,40 @@ void gainspan_TXparam(char* buf)
  * \fn void gainspan_TXchar(char ch)
  * \brief Adds character to TX buffer.
  * \param ch Character to be added to buffer
+ *
+ * Waits for the TX interrupt to make room when the buffer is full. Characters
+ * added while a DMA frame is being sent follow the frame. The character is dropped
+ * if the module holds CTS released for \ref GAINSPAN_CTS_WAIT_MS.
  */
 void gainspan_TXchar(char ch)
 // 
 {
-	gainspan_buf_tx[gainspan_head_tx++] = ch;
-	if (gainspan_head_tx >= HARDWARE_BUFSIZE) gainspan_head_tx = 0;
-	if (gainspan_head_tx == gainspan_tail_tx) 
-	{	// Overflow
-		if (++gainspan_tail_tx >= HARDWARE_BUFSIZE) gainspan_tail_tx = 0;
+	uint8_t head;
+	uint16_t wait;
+	
+	head = gainspan_head_tx + 1;
+	if (head >= HARDWARE_BUFSIZE) head = 0;
+	wait = GAINSPAN_CTS_WAIT_MS;
+	while (head == gainspan_tail_tx)
+	{	// Only the module holding CTS released keeps the buffer full for long
+		if (gainspan_tx_stalled || (wait == 0))
+		{
+			gainspan_tx_stalled = true;
+			gainspan_tx_dropped++;
+			return;
+		}
+		if (gainspan_flow && !IN_CTSE0_ON)
+		{
+			hardware_mdelay(1);
+			wait--;
+		}
 	}
+	gainspan_tx_stalled = false;
+	// Store character before publishing head to the interrupt.
+	gainspan_buf_tx[gainspan_head_tx] = ch;
+	gainspan_head_tx = head;
+	// A DMA frame owns the USART until its callback restarts the buffer.
+	if (!gainspan_dma_busy) usart_set_dre_interrupt_level(USART_GAINSPAN, USART_INT_LVL_LO);
 }
 
 
@@ -135,15 +197,246 @@ void gainspan_TXdata(char* buf)
 
 
 
+/**
+ * \fn char* gainspan_TXdata_start(char* p)
+ * \brief Writes UDP data header into frame buffer.
+ * \param p Where to write
+ * \returns Pointer after header
+ *
+ * Writes the same <ESC><U><CID><IP>:<PORT>: header as gainspan_TXdata().
+ */
+char* gainspan_TXdata_start(char* p)
+{
+	char* s;
+
+	*p++ = 27;
+	*p++ = 'U';
+	*p++ = gainspan_rxesc_cid;
+	for (s = gainspan_param_module_ip; *s != 0; s++) *p++ = *s;
+	*p++ = ':';
+	for (s = gainspan_param_module_port; *s != 0; s++) *p++ = *s;
+	*p++ = ':';
+	return p;
+}
+
+
+
+
+/**
+ * \fn char* gainspan_TXdata_end(char* p)
+ * \brief Writes UDP data trailer into frame buffer.
+ * \param p Where to write, after the data
+ * \returns Pointer after trailer
+ */
+char* gainspan_TXdata_end(char* p)
+{
+	*p++ = 27;
+	*p++ = 'E';
+	return p;
+}
+
+
+
+
+/**
+ * \fn void gainspan_TXbulk(const char* data, uint16_t len)
+ * \brief Sends binary data as UDP bulk data.
+ * \param data Data to be transmitted, any byte values
+ * \param len Number of bytes, up to \ref GAINSPAN_BULK_MAX
+ *
+ * Sends <ESC><Y><CID><IP>:<PORT>:<LENGTH><DATA>, the module takes exactly
+ * the four digit length of data so no trailer is needed.
+ */
+void gainspan_TXbulk(const char* data, uint16_t len)
+{
+	char head[8];
+	uint16_t i;
+
+	if (len > GAINSPAN_BULK_MAX) len = GAINSPAN_BULK_MAX;
+	gainspan_TXchar(27);
+	gainspan_TXchar('Y');
+	gainspan_TXchar(gainspan_rxesc_cid);
+	gainspan_TXparam(gainspan_param_module_ip);
+	gainspan_TXchar(':');
+	gainspan_TXparam(gainspan_param_module_port);
+	gainspan_TXchar(':');
+	gainspan_TXbulk_length(head + 4, len);
+	for (i = 0; i < 4; i++) gainspan_TXchar(head[i]);
+	for (i = 0; i < len; i++) gainspan_TXchar(data[i]);
+}
+
+
+
+
+/**
+ * \fn char* gainspan_TXbulk_start(char* p)
+ * \brief Writes UDP bulk data header into frame buffer.
+ * \param p Where to write
+ * \returns Pointer after header, where the data starts
+ *
+ * Writes <ESC><Y><CID><IP>:<PORT>:0000, the length is set by gainspan_TXbulk_length()
+ * once the data is in the frame.
+ */
+char* gainspan_TXbulk_start(char* p)
+{
+	char* s;
+
+	*p++ = 27;
+	*p++ = 'Y';
+	*p++ = gainspan_rxesc_cid;
+	for (s = gainspan_param_module_ip; *s != 0; s++) *p++ = *s;
+	*p++ = ':';
+	for (s = gainspan_param_module_port; *s != 0; s++) *p++ = *s;
+	*p++ = ':';
+	return gainspan_TXbulk_length(p + 4, 0);
+}
+
+
+
+
+/**
+ * \fn char* gainspan_TXbulk_length(char* data, uint16_t len)
+ * \brief Writes data length into UDP bulk data header.
+ * \param data Start of data, as returned by gainspan_TXbulk_start()
+ * \param len Number of data bytes, up to \ref GAINSPAN_BULK_MAX
+ * \returns data
+ *
+ * The four decimal digits are written just before the data.
+ */
+char* gainspan_TXbulk_length(char* data, uint16_t len)
+{
+	uint8_t i;
+
+	for (i = 1; i <= 4; i++)
+	{
+		data[-i] = '0' + (len % 10);
+		len /= 10;
+	}
+	return data;
+}
+
+
+
+
+/**
+ * \fn static void gainspan_dma_callback(enum dma_channel_status status)
+ * \brief Releases frame and hands USART back to the TX buffer.
+ * \param status DMA channel status
+ */
+static void gainspan_dma_callback(enum dma_channel_status status)
+{
+	gainspan_tx_callback_t done;
+
+	done = gainspan_dma_done;
+	gainspan_dma_busy = false;
+	// Characters queued during the frame
+	if (gainspan_head_tx != gainspan_tail_tx) usart_set_dre_interrupt_level(USART_GAINSPAN, USART_INT_LVL_LO);
+	if (done) done();
+}
+
+
+
+
+/**
+ * \fn bool gainspan_TXdma(const char* buf, uint16_t len, gainspan_tx_callback_t done)
+ * \brief Sends frame buffer to the module by DMA.
+ * \param buf Frame, must not change until done is called
+ * \param len Number of bytes
+ * \param done Called from the DMA interrupt when the last byte has been written to the USART, or NULL
+ * \returns false if a frame or the TX buffer is still being sent
+ *
+ * Each USARTE0 data register empty request moves one byte, so the CPU only takes the
+ * completion interrupt. With flow control the requests are cut off while CTS is released.
+ */
+bool gainspan_TXdma(const char* buf, uint16_t len, gainspan_tx_callback_t done)
+{
+	struct dma_channel_config dmach_conf;
+	irqflags_t flags;
+
+	if ((len == 0) || gainspan_dma_busy) return false;
+	if (gainspan_head_tx != gainspan_tail_tx) return false;
+	// TX buffer empty, its interrupt has nothing left to send
+	usart_set_dre_interrupt_level(USART_GAINSPAN, USART_INT_LVL_OFF);
+
+	memset(&dmach_conf, 0, sizeof(dmach_conf));
+	dma_channel_set_burst_length(&dmach_conf, DMA_CH_BURSTLEN_1BYTE_gc);
+	dma_channel_set_single_shot(&dmach_conf);
+	dma_channel_set_interrupt_level(&dmach_conf, DMA_INT_LVL_LO);
+	dma_channel_set_src_reload_mode(&dmach_conf, DMA_CH_SRCRELOAD_NONE_gc);
+	dma_channel_set_src_dir_mode(&dmach_conf, DMA_CH_SRCDIR_INC_gc);
+	dma_channel_set_dest_reload_mode(&dmach_conf, DMA_CH_DESTRELOAD_NONE_gc);
+	dma_channel_set_dest_dir_mode(&dmach_conf, DMA_CH_DESTDIR_FIXED_gc);
+	dma_channel_set_transfer_count(&dmach_conf, len);
+	dma_channel_set_source_address(&dmach_conf, (uint16_t)(uintptr_t)buf);
+	dma_channel_set_destination_address(&dmach_conf, (uint16_t)(uintptr_t)&USARTE0.DATA);
+
+	// CTS must not change between choosing the trigger and marking the channel busy
+	flags = cpu_irq_save();
+	if (gainspan_flow && !IN_CTSE0_ON) dma_channel_set_trigger_source(&dmach_conf, DMA_CH_TRIGSRC_OFF_gc);
+	else dma_channel_set_trigger_source(&dmach_conf, DMA_CH_TRIGSRC_USARTE0_DRE_gc);
+	dma_channel_write_config(GAINSPAN_DMA_CH, &dmach_conf);
+	gainspan_dma_done = done;
+	gainspan_dma_busy = true;
+	dma_set_callback(GAINSPAN_DMA_CH, gainspan_dma_callback);
+	// Data register is empty, the first request is made at once
+	dma_channel_enable(GAINSPAN_DMA_CH);
+	cpu_irq_restore(flags);
+	return true;
+}
+
+
+
+
+/**
+ * \fn ISR(PORTE_INT0_vect)
+ * \brief Stops or restarts TX when the module changes CTS.
+ *
+ * The TX buffer interrupt stops itself while CTS is released, a DMA frame has its
+ * trigger turned off. At most the bytes already in the USART are sent after CTS is released.
+ */
+ISR(PORTE_INT0_vect)
+{
+	DMA_CH_t* dmach;
+
+	if (!gainspan_flow) return;
+	dmach = dma_get_channel_address_from_num(GAINSPAN_DMA_CH);
+	if (IN_CTSE0_ON)
+	{	// Module can receive again
+		if (gainspan_dma_busy) dmach->TRIGSRC = DMA_CH_TRIGSRC_USARTE0_DRE_gc;
+		else if (gainspan_head_tx != gainspan_tail_tx) usart_set_dre_interrupt_level(USART_GAINSPAN, USART_INT_LVL_LO);
+	}
+	else if (gainspan_dma_busy) dmach->TRIGSRC = DMA_CH_TRIGSRC_OFF_gc;
+}
+
+
+
+
+/**
+ * \fn uint8_t gainspan_RXspace(void)
+ * \brief Returns free bytes in RX buffer.
+ * \returns Bytes the RX interrupt can still store
+ */
+uint8_t gainspan_RXspace(void)
+{
+	int16_t space;
+
+	space = (int16_t)gainspan_tail_rx - gainspan_head_rx - 1;
+	if (space < 0) space += HARDWARE_BUFSIZE;
+	return space;
+}
+
+
+
+
 /**
  * \fn void gainspan_RXreset()
  * \brief Reset RX buffer.
  */
 void gainspan_RXreset()
 {
-	gainspan_tail_rx = 0;
-	gainspan_head_rx = 0;
-	gainspan_rxcr   = 0;
+	// Discard received data, head belongs to the RX interrupt.
+	gainspan_tail_rx = gainspan_head_rx;
+	gainspan_rxcr_out = gainspan_rxcr_in;
 	gainspan_module_adapter = 0;
 	gainspan_module_connection = 0;
 }
@@ -157,7 +450,7 @@ void gainspan_RXreset()
  */
 uint8_t gainspan_RXresponse() 
 {
-	if (gainspan_tail_rx != gainspan_head_rx) return gainspan_rxcr;
+	if (gainspan_tail_rx != gainspan_head_rx) return (uint8_t)(gainspan_rxcr_in - gainspan_rxcr_out);
 	return 0;
 }
 
@@ -214,8 +507,8 @@ uint8_t gainspan_RXequals(char * ans)
 		// Is there a trailing <CR>?
 		if (gainspan_buf_rx[gainspan_tail_rx] == 13)
 		{  // Consume <CR>
-			if (++gainspan_tail_rx > HARDWARE_BUFSIZE) gainspan_tail_rx = 0;
-			if (gainspan_rxcr > 0) gainspan_rxcr--;
+			if (++gainspan_tail_rx >= HARDWARE_BUFSIZE) gainspan_tail_rx = 0;
+			if (gainspan_rxcr_out != gainspan_rxcr_in) gainspan_rxcr_out++;
 		}
 		return true;
 	}
@@ -244,11 +537,11 @@ uint8_t gainspan_RXconsume()
 	if (ch == 13)
 	{
 		if (++gainspan_tail_rx >= HARDWARE_BUFSIZE) gainspan_tail_rx = 0;
-		if (gainspan_rxcr > 0) gainspan_rxcr--;
+		if (gainspan_rxcr_out != gainspan_rxcr_in) gainspan_rxcr_out++;
 	}
 	// Otherwise must have exhausted buffer (should not happen)
-	else gainspan_rxcr = 0;   // Should already be zero
-	return gainspan_rxcr;
+	else gainspan_rxcr_out = gainspan_rxcr_in;   // Should already be equal
+	return (uint8_t)(gainspan_rxcr_in - gainspan_rxcr_out);
 }
 
 
@@ -278,7 +571,7 @@ void gainspan_RXparam(char * param)
 			if (++i >= HARDWARE_BUFSIZESML) i--;
 		}
 		// Track any swallowed <CR>
-		if ((ch == 13) && (gainspan_rxcr > 0)) gainspan_rxcr--;
+		if ((ch == 13) && (gainspan_rxcr_out != gainspan_rxcr_in)) gainspan_rxcr_out++;
 
 	}
 	while ((ch != 13) && (ch != 0));
@@ -297,6 +590,9 @@ void gainspan_RXparam(char * param)
  * \returns true if data put in buffer
  *
  * Copies received data into parameter encapsulated by <ESC><u><CID><IP><SPACE><PORT><TAB><DATA><ESC><E>
+ * or by <ESC><y><CID><IP><SPACE><PORT><TAB><LENGTH><DATA> bulk data, where every byte value is kept.
+ * The number of bytes is in \ref gainspan_rxdata_len as bulk data may contain 0x00.
+ * Characters outside escape sequences are passed to atcmd_rx().
  */
 uint8_t gainspan_RXdata(char * param)
 {
@@ -311,12 +607,17 @@ uint8_t gainspan_RXdata(char * param)
 		switch(gainspan_rxesc_data)
 		{
 			case 0:
-				// Waiting for data
+				// Waiting for data, other text is AT command response
 				if (ch == 27) gainspan_rxesc_data++;
+				else atcmd_rx(ch);
 				break;
 			case 1:
-				// Have we got <u> for start of data or something else?
-				if (ch == 'u') gainspan_rxesc_data++;
+				// Have we got <u> for start of data, <y> for bulk data or something else?
+				if ((ch == 'u') || (ch == 'y'))
+				{
+					gainspan_rxesc_bulk = (ch == 'y');
+					gainspan_rxesc_data++;
+				}
 				else gainspan_rxesc_data = 99;
 				break;
 			case 2:
@@ -349,10 +650,11 @@ uint8_t gainspan_RXdata(char * param)
 				if (ch == 27) gainspan_rxesc_data = 0;
 				// If <TAB> then marks end of Port and start of data
 				else if (ch == 9) 
-				{	// Done with port, ready for data
+				{	// Done with port, ready for data or bulk data length
 					gainspan_param_module_port[gainspan_rxesc_i] = 0;
 					gainspan_rxesc_i = 0;
-					gainspan_rxesc_data++;
+					gainspan_rxesc_len = 0;
+					gainspan_rxesc_data = gainspan_rxesc_bulk ? 7 : 5;
 				}
 				else if (ch >= ' ')
 				{	// Receiving port
@@ -383,6 +685,33 @@ uint8_t gainspan_RXdata(char * param)
 */
 				// Finished
 				param[gainspan_rxesc_i] = 0;
+				gainspan_rxdata_len = gainspan_rxesc_i;
+				gainspan_rxesc_data = 0;
+				return true;
+			case 7:
+				// Catching four digit bulk data length
+				if ((ch < '0') || (ch > '9'))
+				{	// Not bulk data after all
+					gainspan_rxesc_data = 0;
+					break;
+				}
+				gainspan_rxesc_len = gainspan_rxesc_len * 10 + (ch - '0');
+				if (++gainspan_rxesc_i < 4) break;
+				gainspan_rxesc_i = 0;
+				gainspan_rxesc_data++;
+				if (gainspan_rxesc_len > 0) break;
+				// Empty datagram, nothing to catch
+				// Fall through
+			case 8:
+				// Catching bulk data, any byte value, length counts it so <ESC> is data
+				if (gainspan_rxesc_len > 0)
+				{	// Bytes beyond the parameter are dropped
+					gainspan_rxesc_len--;
+					if (gainspan_rxesc_i < HARDWARE_BUFSIZESML - 1) param[gainspan_rxesc_i++] = ch;
+				}
+				if (gainspan_rxesc_len > 0) break;
+				param[gainspan_rxesc_i] = 0;
+				gainspan_rxdata_len = gainspan_rxesc_i;
 				gainspan_rxesc_data = 0;
 				return true;
 			default:
@@ -405,13 +734,32 @@ uint8_t gainspan_RXdata(char * param)
  * \param cmd Command buffer
  * \param param Parameter buffer for response
  * \returns 1 if successful otherwise 0
+ *
+ * Waits for the response, only used before the main loop starts. Use atcmd_queue() from the main loop.
  */
 uint8_t gainspan_TXexecute(char * cmd, char * param)
 // Will overwrite param even if unsuccessful.
+{
+	return gainspan_TXexecute_wait(cmd, param, GAINSPAN_COMMAND_WAIT_MS);
+}
+
+
+
+
+/**
+ * \fn uint8_t gainspan_TXexecute_wait(char * cmd, char * param, uint16_t ms)
+ * \brief Sends command and receives any data to param buffer, waiting at most ms for the response.
+ * \param cmd Command buffer
+ * \param param Parameter buffer for response
+ * \param ms Wait in milliseconds for OK or ERROR
+ * \returns 1 if successful, 0 on ERROR, 10 if no response
+ */
+uint8_t gainspan_TXexecute_wait(char * cmd, char * param, uint16_t ms)
+// Will overwrite param even if unsuccessful.
 {
 	uint16_t wait;
 	gainspan_TX(cmd);
-	wait = GAINSPAN_COMMAND_WAIT_MS;
+	wait = ms;
 	while(wait > 0)
 	{
 		user_mdelay_tick(1);
@@ -430,4 +778,97 @@ uint8_t gainspan_TXexecute(char * cmd, char * param)
 
 
 
+/**
+ * \fn static bool gainspan_TXdrain(void)
+ * \brief Waits until TX buffer and DMA frame have been sent.
+ * \returns false if the module held CTS released for \ref GAINSPAN_CTS_WAIT_MS
+ */
+static bool gainspan_TXdrain(void)
+{
+	uint16_t wait;
+
+	wait = GAINSPAN_CTS_WAIT_MS;
+	while ((gainspan_head_tx != gainspan_tail_tx) || gainspan_dma_busy)
+	{
+		if (gainspan_flow && !IN_CTSE0_ON)
+		{
+			if (wait == 0) return false;
+			hardware_mdelay(1);
+			wait--;
+		}
+	}
+	return true;
+}
+
+
+
+
+/**
+ * \fn static bool gainspan_baud_check(uint32_t baud)
+ * \brief Moves USART to baud rate and checks the module answers.
+ * \param baud Baud rate
+ * \returns true if module replied OK to `AT`, false also if the old rate could not be emptied
+ */
+static bool gainspan_baud_check(uint32_t baud)
+{
+	// Let the last byte leave at the old rate
+	if (!gainspan_TXdrain()) return false;
+	user_mdelay_tick(GAINSPAN_BAUD_SETTLE_MS);
+	usart_set_baudrate(USART_GAINSPAN, baud, sysclk_get_per_hz());
+	gainspan_baud = baud;
+	gainspan_RXreset();
+	return (gainspan_TXexecute_wait("AT\r\n", gainspan_param_debug, GAINSPAN_BAUD_WAIT_MS) == 1);
+}
+
+
+
+
+/**
+ * \fn bool gainspan_flow_enable(void)
+ * \brief Turns on RTS/CTS flow control of the USART.
+ * \returns false if the module does not drive CTS low, flow control stays off
+ *
+ * Called once the module has answered OK to `AT&R1`. TX then waits while the module
+ * releases CTS, RTS is always driven from the RX buffer space.
+ */
+bool gainspan_flow_enable(void)
+{
+	// Line not fitted or module not ready
+	if (!IN_CTSE0_ON) return false;
+	gainspan_flow = true;
+	// Interrupt on both edges of CTS
+	PORTE.INT0MASK = (1 << 1);
+	PORTE.INTCTRL = (PORTE.INTCTRL & ~PORT_INT0LVL_gm) | PORT_INT0LVL_LO_gc;
+	return true;
+}
+
 
+
+
+/**
+ * \fn uint32_t gainspan_negotiate_baud(void)
+ * \brief Raises baud rate of module and USART to the highest rate that works.
+ * \returns Baud rate in use
+ *
+ * Rates are tried from highest. A rate the module accepts but does not answer at is undone
+ * by sending `ATB` with the default rate at the new rate. If the module does not answer
+ * at the default rate either the USART stays at the default rate.
+ */
+uint32_t gainspan_negotiate_baud(void)
+{
+	char cmd[HARDWARE_BUFSIZESML];
+	uint8_t i;
+
+	for (i = 0; i < sizeof(gainspan_bauds) / sizeof(gainspan_bauds[0]); i++)
+	{
+		sprintf(cmd, "ATB=%lu\r\n", gainspan_bauds[i]);
+		// Module refused, still at current rate
+		if (gainspan_TXexecute_wait(cmd, gainspan_param_debug, GAINSPAN_BAUD_WAIT_MS) != 1) continue;
+		if (gainspan_baud_check(gainspan_bauds[i])) return gainspan_baud;
+		// Link failed at new rate, return module to default rate
+		sprintf(cmd, "ATB=%lu\r\n", (uint32_t)USART_GAINSPAN_BAUDRATE);
+		gainspan_TX(cmd);
+		if (!gainspan_baud_check(USART_GAINSPAN_BAUDRATE)) break;
+	}
+	return gainspan_baud;
+}
@@ -9,20 +9,32 @@
 
 
 #define GAINSPAN_COMMAND_WAIT_MS	20000	/**< Wait in milliseconds for command response */
+#define GAINSPAN_BAUD_WAIT_MS		500		/**< Wait in milliseconds for response while changing baud rate */
+#define GAINSPAN_BAUD_SETTLE_MS		10		/**< Wait in milliseconds before changing USART baud rate */
+#define GAINSPAN_DMA_CH				2		/**< DMA channel writing frames to USARTE0, channels 0 and 1 belong to the sampler */
+#define GAINSPAN_RTS_OFF_SPACE		32		/**< RX buffer free bytes at or below which RTS asks the module to stop */
+#define GAINSPAN_RTS_ON_SPACE		64		/**< RX buffer free bytes at or above which RTS lets the module send again */
+#define GAINSPAN_CTS_WAIT_MS		100		/**< Wait in milliseconds for the module to assert CTS before TX bytes are dropped */
+#define GAINSPAN_BULK_MAX			1400	/**< Most bytes sent in one bulk data datagram */
+
+
+typedef void (*gainspan_tx_callback_t)(void);	/**< Called when a DMA frame has been sent */
 
 
 
 char gainspan_buf_tx[HARDWARE_BUFSIZE];	/**< Serial TX circular buffer */
-uint8_t gainspan_head_tx;	/**< Head index in TX circular buffer */
-uint8_t gainspan_tail_tx;	/**< Tail Index in TX circular buffer */
+volatile uint8_t gainspan_head_tx;	/**< Head index in TX circular buffer, written by main loop */
+volatile uint8_t gainspan_tail_tx;	/**< Tail Index in TX circular buffer, written by DRE interrupt */
 char gainspan_buf_rx[HARDWARE_BUFSIZE];	/**< Serial RX buffer */
-uint8_t gainspan_head_rx;	/**< Head index in RX circular buffer */
-uint8_t gainspan_tail_rx;	/**< Tail Index in RX circular buffer */
+volatile uint8_t gainspan_head_rx;	/**< Head index in RX circular buffer, written by RX interrupt */
+volatile uint8_t gainspan_tail_rx;	/**< Tail Index in RX circular buffer, written by main loop */
 
 uint8_t gainspan_rxesc_data;
 uint8_t gainspan_rxesc_i;
 uint8_t gainspan_rxesc_cid;
-uint8_t gainspan_rxcr;
+volatile uint8_t gainspan_rxcr_in;	/**< <CR> received, counted by RX interrupt */
+uint8_t gainspan_rxcr_out;			/**< <CR> consumed by the parsers, received less consumed are waiting */
+uint8_t gainspan_rxdata_len;		/**< Bytes put in parameter by the last gainspan_RXdata(), bulk data may contain 0x00 */
 
 
 // Parameters
@@ -38,6 +50,11 @@ char gainspan_param_module_ip[HARDWARE_BUFSIZESML];		/**< IP address for UDP com
 uint8_t gainspan_module_adapter;		/**< Adapter is first digit from CONNECT string */
 uint8_t gainspan_module_connection;	/**< Connection is second digit from CONNECT string */
 
+uint32_t gainspan_baud;		/**< Baud rate of GainSpan USART */
+volatile bool gainspan_dma_busy;	/**< DMA frame is being sent, TX buffer waits for it */
+volatile bool gainspan_flow;		/**< Module uses RTS/CTS flow control, TX waits for CTS */
+uint16_t gainspan_tx_dropped;		/**< TX bytes dropped because the module held CTS released */
+
 
 
 
@@ -74,6 +91,48 @@ void gainspan_TXchar(char ch);
  */
 void gainspan_TXdata(char* buf);
 
+/**
+ * \fn char* gainspan_TXdata_start(char* p)
+ * \brief Writes UDP data header into frame buffer.
+ */
+char* gainspan_TXdata_start(char* p);
+
+/**
+ * \fn char* gainspan_TXdata_end(char* p)
+ * \brief Writes UDP data trailer into frame buffer.
+ */
+char* gainspan_TXdata_end(char* p);
+
+/**
+ * \fn void gainspan_TXbulk(const char* data, uint16_t len)
+ * \brief Sends binary data as UDP bulk data.
+ */
+void gainspan_TXbulk(const char* data, uint16_t len);
+
+/**
+ * \fn char* gainspan_TXbulk_start(char* p)
+ * \brief Writes UDP bulk data header into frame buffer.
+ */
+char* gainspan_TXbulk_start(char* p);
+
+/**
+ * \fn char* gainspan_TXbulk_length(char* data, uint16_t len)
+ * \brief Writes data length into UDP bulk data header.
+ */
+char* gainspan_TXbulk_length(char* data, uint16_t len);
+
+/**
+ * \fn bool gainspan_TXdma(const char* buf, uint16_t len, gainspan_tx_callback_t done)
+ * \brief Sends frame buffer to the module by DMA.
+ */
+bool gainspan_TXdma(const char* buf, uint16_t len, gainspan_tx_callback_t done);
+
+/**
+ * \fn uint8_t gainspan_RXspace(void)
+ * \brief Returns free bytes in RX buffer.
+ */
+uint8_t gainspan_RXspace(void);
+
 /**
  * \fn void gainspan_RXreset()
  * \brief Reset RX buffer.
@@ -123,4 +182,25 @@ uint8_t gainspan_RXdata(char * param);
 uint8_t gainspan_TXexecute(char * cmd, char * param);
 
 
+/**
+ * \fn uint8_t gainspan_TXexecute_wait(char * cmd, char * param, uint16_t ms)
+ * \brief Sends command and receives any data to param buffer, waiting at most ms.
+ */
+uint8_t gainspan_TXexecute_wait(char * cmd, char * param, uint16_t ms);
+
+
+/**
+ * \fn bool gainspan_flow_enable(void)
+ * \brief Turns on RTS/CTS flow control of the USART once the module has accepted `AT&R1`.
+ */
+bool gainspan_flow_enable(void);
+
+
+/**
+ * \fn uint32_t gainspan_negotiate_baud(void)
+ * \brief Raises baud rate of module and USART to the highest rate that works.
+ */
+uint32_t gainspan_negotiate_baud(void);
+
+
 #endif // GAINSPAN_H
@@ -22,6 +22,8 @@
  * - `PD1`  --> Pin 21: `EN3V3` enables 3.3V supply to peripherals
  * - `TXE0` --> Pin 33: UART `TX0` connected to GainSpan module
  * - `RXE0` --> Pin 32: UART `RX0` connected to GainSpan module
+ * - `PE1`  --> Pin 29: `CTS0` input, low when GainSpan module can receive (module `RTS`)
+ * - `PD4`  --> Pin 24: `RTS0` output, low when GainSpan RX buffer has room (module `CTS`)
  * - `TXD0` --> Pin 23: UART `TX1` connected to FTDI USB serial
  * - `RXD0` --> Pin 22: UART `RX1` connected to FTDI USB serial 
  *
@@ -40,6 +42,7 @@
 #include "adc.h"
 
 #include "hardware.h"
+#include "sampler.h"
 
 
 // ADC Configuration structures
@@ -67,6 +70,14 @@ struct dac_config			dac_conf;	/**< DAC config structure */
 void hardware_init(void)
 {
 	
+	// Keep RC32M at 32 MHz with the DFLL, referenced to the internal 32.768 kHz oscillator
+	osc_enable(OSC_ID_RC32KHZ);
+	osc_wait_ready(OSC_ID_RC32KHZ);
+	DFLLRC32M.COMP1 = LSB(HARDWARE_DFLL_COMP);
+	DFLLRC32M.COMP2 = MSB(HARDWARE_DFLL_COMP);
+	OSC.DFLLCTRL = (OSC.DFLLCTRL & ~OSC_RC32MCREF_gm) | OSC_RC32MCREF_RC32K_gc;
+	DFLLRC32M.CTRL |= DFLL_ENABLE_bm;
+	
 	// Initialize the LED on PORTD 
 	ioport_configure_pin(LED1, IOPORT_DIR_OUTPUT | IOPORT_INIT_LOW);
 	
@@ -77,6 +88,9 @@ void hardware_init(void)
 	// Initialize USARTE0
 	ioport_configure_pin(TXE0, IOPORT_DIR_OUTPUT | IOPORT_INIT_HIGH);
 	ioport_configure_pin(RXE0, IOPORT_DIR_INPUT);
+	// Flow control, PE1 is the only spare PORTE pin so RTS is on PORTD
+	ioport_configure_pin(CTSE0, IOPORT_DIR_INPUT | IOPORT_PULL_UP | IOPORT_BOTHEDGES);
+	ioport_configure_pin(RTSE0, IOPORT_DIR_OUTPUT | IOPORT_INIT_LOW);
 	
 	// Initialize I/O control for peripherals 3.3V supply and translator
 	ioport_configure_pin(EN3V3, IOPORT_DIR_OUTPUT | IOPORT_INIT_LOW);
@@ -114,22 +128,16 @@ void hardware_init(void)
 	adcch_set_input(&adcch_conf, ADCCH_POS_PIN3, ADCCH_NEG_NONE, 1);
 	adc_write_configuration(&ADCA, &adc_conf);
 	adcch_write_configuration(&ADCA, ADC_CH2, &adcch_conf);
+	// Channel 3 - pin 4
+	adcch_read_configuration(&ADCA, ADC_CH3, &adcch_conf);
+	adc_set_conversion_parameters(&adc_conf, ADC_SIGN_OFF, ADC_RES_12, ADC_REF_VCC);
+	adc_set_conversion_trigger(&adc_conf, ADC_TRIG_MANUAL, 1, 0);
+	adc_set_clock_rate(&adc_conf, 200000UL);
+	adcch_set_input(&adcch_conf, ADCCH_POS_PIN4, ADCCH_NEG_NONE, 1);
+	adc_write_configuration(&ADCA, &adc_conf);
+	adcch_write_configuration(&ADCA, ADC_CH3, &adcch_conf);
 	
-	/*
-	// Setup DAC clock
-	// Use the sysclk service to enable the clock to the event system
-	//sysclk_enable_module(SYSCLK_PORT_GEN, SYSCLK_EVSYS);
-	// Connect TCC0 overflow to event channel 3
-	//EVSYS.CH3MUX = EVSYS_CHMUX_TCC0_OVF_gc;
-	// Enable the clock to the DAC trigger timer
-	tc_enable(&TCC0);
-	// Configure the DAC trigger timer in normal Waveform Generator mode
-	tc_set_wgm(&TCC0, TC_WG_NORMAL);
-	// Configure the DAC trigger timer period to overflow at the specified rate of conversion in Hz
-	tc_write_period(&TCC0, (sysclk_get_per_hz() / 500) - 1);
-	// Configure the DAC trigger timer clock source to use the peripheral bus frequency
-	tc_write_clock_source(&TCC0, TC_CLKSEL_DIV1_gc);
-	*/
+	// DAC trigger timer TCC0 and event channel 3 are set up by wave_init()
 	
 		
 	// Configuration of DAC
@@ -138,6 +146,9 @@ void hardware_init(void)
 	dac_set_conversion_parameters(&dac_conf, DAC_REF_AVCC, DAC_ADJ_RIGHT);
 	dac_set_active_channel(&dac_conf, DAC_CH0 | DAC_CH1, 0);
 	dac_set_conversion_trigger(&dac_conf, 0, DAC_CH0 | DAC_CH1);
+	// Timing is in peripheral clocks, set after channels so dual channel mode is allowed for
+	dac_set_conversion_interval(&dac_conf, HARDWARE_DAC_CONV_US);
+	dac_set_refresh_interval(&dac_conf, HARDWARE_DAC_REFRESH_US);
 	dac_write_configuration(&DACB, &dac_conf);
 	
 	
@@ -153,7 +164,7 @@ void hardware_init(void)
 	OUT_EN3V3_OFF;
 	OUT_LED1_ON;
 	
-	// Enable the ADC
+	// Enable the ADC, factory calibration is loaded by calib_init()
 	adc_enable(&ADCA);
 	// Enable the DAC
 	dac_enable(&DACB);
@@ -165,11 +176,20 @@ void hardware_init(void)
 /**
  * \fn uint16_t hardware_read_adc(uint8_t ch)
  * \brief Read ADC pin and returns ADC pin value.
- * \param ch ADC channel (ASCII character) '0', '1' or '2' (default)
+ * \param ch ADC channel (ASCII character) '0', '1', '3' or '2' (default)
  * \returns ADC reading
+ *
+ * When the sampler is running the latest background result is returned, otherwise
+ * a manual conversion is started and waited for.
  */
 uint16_t hardware_read_adc(uint8_t ch)
-{	// Read channel
+{	// Sampler already converting in background?
+	if (sampler_mode != SAMPLER_MODE_OFF)
+	{	// Return latest result without waiting
+		if ((ch >= '0') && (ch <= '3')) return sampler_read_latest(ch - '0');
+		else return sampler_read_latest(2);
+	}
+	// Read channel
 	if (ch == '0')
 	{	
 		adc_start_conversion(&ADCA, ADC_CH0);
@@ -182,6 +202,12 @@ uint16_t hardware_read_adc(uint8_t ch)
 		adc_wait_for_interrupt_flag(&ADCA, ADC_CH1);
 		return adc_get_result(&ADCA, ADC_CH1);
 	}
+	else if (ch == '3')
+	{
+		adc_start_conversion(&ADCA, ADC_CH3);
+		adc_wait_for_interrupt_flag(&ADCA, ADC_CH3);
+		return adc_get_result(&ADCA, ADC_CH3);
+	}
 	else
 	{
 		adc_start_conversion(&ADCA, ADC_CH2);
@@ -212,6 +238,72 @@ void hardware_write_dac(uint8_t ch, uint16_t val)
 }
 
 
+/**
+ * \fn uint32_t hardware_set_timer_rate(volatile void* tc, uint32_t hz)
+ * \brief Sets timer prescaler and period to overflow at required rate.
+ * \param tc Timer to set, must already be enabled
+ * \param hz Required overflow rate in Hz
+ * \returns Timer clock in Hz after prescaler
+ *
+ * Uses the smallest prescaler that fits the period in 16 bits. Starts the timer.
+ */
+uint32_t hardware_set_timer_rate(volatile void* tc, uint32_t hz)
+{
+	uint32_t clk;
+	TC_CLKSEL_t clksel;
+	
+	if (hz == 0) hz = 1;
+	clk = sysclk_get_per_hz();
+	// Find smallest prescaler with 16 bit period
+	if ((clk / hz) <= 0x10000UL) clksel = TC_CLKSEL_DIV1_gc;
+	else if ((clk / 8 / hz) <= 0x10000UL)
+	{
+		clksel = TC_CLKSEL_DIV8_gc;
+		clk /= 8;
+	}
+	else if ((clk / 64 / hz) <= 0x10000UL)
+	{
+		clksel = TC_CLKSEL_DIV64_gc;
+		clk /= 64;
+	}
+	else
+	{
+		clksel = TC_CLKSEL_DIV1024_gc;
+		clk /= 1024;
+	}
+	tc_set_wgm(tc, TC_WG_NORMAL);
+	tc_write_period(tc, (clk / hz) - 1);
+	tc_write_clock_source(tc, clksel);
+	return clk;
+}
+
+
+/**
+ * \fn int16_t hardware_read_hex(const char* s, uint8_t digits)
+ * \brief Reads hex digits.
+ * \param s Characters to read
+ * \param digits Number of digits, at most 3
+ * \returns Value, -1 if a character is not a hex digit
+ */
+int16_t hardware_read_hex(const char* s, uint8_t digits)
+{
+	int16_t val;
+	char ch;
+
+	val = 0;
+	while (digits-- > 0)
+	{
+		ch = *s++;
+		if ((ch >= '0') && (ch <= '9')) ch -= '0';
+		else if ((ch >= 'A') && (ch <= 'F')) ch -= 'A' - 10;
+		else if ((ch >= 'a') && (ch <= 'f')) ch -= 'a' - 10;
+		else return -1;
+		val = (val << 4) | ch;
+	}
+	return val;
+}
+
+
 /**
  * \fn static void hardware_mdelay(uint16_t ms)
  * \brief Loops for required delay in milliseconds
@@ -33,6 +33,8 @@ uint16_t hardware_adc[6];	/**< ADC channel results array */
 #define ENTXS		IOPORT_CREATE_PIN(PORTE,0)
 #define RXE0		IOPORT_CREATE_PIN(PORTE,2)
 #define TXE0		IOPORT_CREATE_PIN(PORTE,3)
+#define CTSE0		IOPORT_CREATE_PIN(PORTE,1)
+#define RTSE0		IOPORT_CREATE_PIN(PORTD,4)
 #define SWITCH		IOPORT_CREATE_PIN(PORTA,5)
 #define DOUT1		IOPORT_CREATE_PIN(PORTB,0)
 #define DOUT2		IOPORT_CREATE_PIN(PORTB,1)
@@ -49,6 +51,9 @@ uint16_t hardware_adc[6];	/**< ADC channel results array */
 #define OUT_DOUT2_OFF		gpio_set_pin_low(DOUT2)
 #define OUT_DOUT2_ON		gpio_set_pin_high(DOUT2)
 #define IN_SWITCH_DOWN		gpio_pin_is_low(SWITCH)
+#define OUT_RTSE0_OFF		gpio_set_pin_high(RTSE0)
+#define OUT_RTSE0_ON		gpio_set_pin_low(RTSE0)
+#define IN_CTSE0_ON			gpio_pin_is_low(CTSE0)
 
 
 /*
@@ -62,6 +67,10 @@ uint16_t hardware_adc[6];	/**< ADC channel results array */
 #define HARDWARE_BUFSIZE		250		/**< def USART buffer size */
 #define HARDWARE_BUFSIZESML		32
 
+#define HARDWARE_DFLL_COMP		(32000000UL / 1024)	/**< RC32M cycles in each 1.024 kHz DFLL reference tick */
+#define HARDWARE_DAC_CONV_US	3		/**< DAC conversion interval in us, dual channel needs at least 1.5 us */
+#define HARDWARE_DAC_REFRESH_US	16		/**< DAC dual channel refresh interval in us, at most 30 us */
+
 
 
 /**
@@ -86,6 +95,20 @@ uint16_t hardware_read_adc(uint8_t ch);
 void hardware_write_dac(uint8_t ch, uint16_t val);
 
 
+/**
+ * \fn uint32_t hardware_set_timer_rate(volatile void* tc, uint32_t hz)
+ * \brief Sets timer prescaler and period to overflow at required rate.
+ */
+uint32_t hardware_set_timer_rate(volatile void* tc, uint32_t hz);
+
+
+/**
+ * \fn int16_t hardware_read_hex(const char* s, uint8_t digits)
+ * \brief Reads hex digits, returns -1 if not hex.
+ */
+int16_t hardware_read_hex(const char* s, uint8_t digits);
+
+
 /**
  * \fn void hardware_mdelay(uint16_t ms)
  * \brief Loops for required delay in milliseconds
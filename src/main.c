@@ -11,6 +11,18 @@
  * Some important project information is contained in the following pages:
  * - [Hardware Pinouts](\ref HardwarePinouts) - pinouts for the CEDSCOPE-0 PCB.
  * - [User Interface Guide](\ref UserInterfaceGuide) - user command and mode description.
+ * - [Sampler Guide](\ref SamplerGuide) - background ADC acquisition.
+ * - [Trigger Guide](\ref TriggerGuide) - triggered acquisition.
+ * - [Calibration Guide](\ref CalibrationGuide) - ADC offset and gain correction.
+ * - [Capture Guide](\ref CaptureGuide) - block capture command.
+ * - [Equivalent-Time Guide](\ref EtsGuide) - equivalent-time sampling of repetitive signals.
+ * - [Range Guide](\ref RangeGuide) - automatic channel gain and reference selection.
+ * - [Alarm Guide](\ref AlarmGuide) - channel level and window alarms.
+ * - [Waveform Guide](\ref WaveGuide) - timer clocked DAC waveform playback.
+ * - [DDS Guide](\ref DdsGuide) - sine, triangle and square generator on the DAC channels.
+ * - [Upload Guide](\ref UploadGuide) - chunked DAC table upload with CRC checks.
+ * - [Bode Guide](\ref BodeGuide) - frequency response sweep measured on the device.
+ * - [AT Command Guide](\ref AtCommandGuide) - queued GainSpan commands answered without waiting.
  *
  *
  */
@@ -21,12 +33,25 @@
  */
 #include <asf.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "hardware.h"
 #include "user.h"
 #include "conf_usart_serial.h"
 #include "gainspan.h"
+#include "sampler.h"
+#include "calib.h"
+#include "trigger.h"
+#include "capture.h"
+#include "ets.h"
+#include "range.h"
+#include "alarm.h"
+#include "wave.h"
+#include "dds.h"
+#include "upload.h"
+#include "bode.h"
+#include "atcmd.h"
 
 #define VERSION			"\r\nCedScope v1.0.06\r\n\0"
 
@@ -35,6 +60,67 @@
 //#define USE_WIFI_JRRSFT
 #define USE_WIFI_AP_CEDRIC
 
+#define MAIN_READ_SAMPLES	8	/**< Samples sent in each reply to `@tread` */
+#define MAIN_CONNECT_RETRIES	3		/**< Connect attempts before giving up */
+#define MAIN_CONNECT_PAUSE_MS	1000	/**< Pause before each connect attempt */
+
+
+#ifdef USE_WIFI_JRRSFT
+#define MAIN_WIFI_NAME		"WIFI_JRRSFT\r\n"
+static const char* const main_connect_cmds[] =
+{
+	"AT+WWPA=onestationlane\r\n",
+	"AT+WM=0\r\n",
+	"AT+NDHCP=1\r\n",
+	"AT+WA=jrrsft\r\n",
+	"AT+NSTAT=?\r\n"
+};	/**< Connect sequence, all must be OK before UDP is started */
+#endif
+#ifdef USE_WIFI_AP_CEDRIC
+#define MAIN_WIFI_NAME		"WIFI_AP_CEDRIC\r\n"
+static const char* const main_connect_cmds[] =
+{
+	"AT+WRXACTIVE=1\r\n",
+	"AT+WSEC=1\r\n",
+	"AT+WM=2\r\n",
+	"AT+DHCPSRVR=1\r\n",
+	"AT+WA=Cedric\r\n"
+};	/**< Connect sequence, all must be OK before UDP is started */
+#endif
+
+#ifndef USE_NO_WIFI
+static const char* const main_version_cmds[] =
+{
+	"ATI0\r\n",
+	"ATI1\r\n",
+	"ATI2\r\n"
+};	/**< Version query, all must be OK for SUCCESS */
+static char* const main_version_params[] =
+{
+	gainspan_param_module_i0,
+	gainspan_param_module_i1,
+	gainspan_param_module_i2
+};	/**< Where each version response is kept */
+
+enum main_connect_states
+{
+	MAIN_CONNECT_MODULE,
+	MAIN_CONNECT_VERSION,
+	MAIN_CONNECT_PAUSE,
+	MAIN_CONNECT_SETUP,
+	MAIN_CONNECT_UDP,
+	MAIN_CONNECT_DONE
+};	/**< Connect sequence state enumerations */
+
+static enum main_connect_states main_connect_state;	/**< Current connect sequence state */
+static uint8_t main_connect_ok;		/**< Commands of current step answered OK */
+static uint8_t main_version_i;		/**< Version command being answered */
+static uint8_t main_connect_retry;	/**< Connect attempts left */
+static uint16_t main_connect_wait;	/**< Milliseconds before next attempt */
+static bool main_connected;			/**< UDP started, datagrams are handled */
+static bool main_console_busy;		/**< Console command queued, input buffer is in use */
+#endif
+
 
 
 /**
@@ -60,21 +146,251 @@ static void mdelay(uint16_t ms)
 
 
 
+#ifndef USE_NO_WIFI
+/**
+ * \fn static void main_version_done(enum atcmd_results result, char* line)
+ * \brief Keeps response of each version command and counts those answered OK.
+ * \param result Callback reason
+ * \param line Response line
+ */
+static void main_version_done(enum atcmd_results result, char* line)
+{
+	if (main_version_i >= sizeof(main_version_params) / sizeof(main_version_params[0])) return;
+	if (result == ATCMD_RESULT_DATA)
+	{	// Last line of response is kept, lines are shorter than the parameter
+		strcpy(main_version_params[main_version_i], line);
+		return;
+	}
+	if (result == ATCMD_RESULT_OK) main_connect_ok++;
+	main_version_i++;
+}
+
+
+
+/**
+ * \fn static void main_flow_done(enum atcmd_results result, char* line)
+ * \brief Turns on USART flow control when the module has accepted `AT&R1`.
+ * \param result Callback reason
+ * \param line Response line
+ */
+static void main_flow_done(enum atcmd_results result, char* line)
+{
+	if (result == ATCMD_RESULT_DATA) return;
+	if ((result == ATCMD_RESULT_OK) && gainspan_flow_enable())
+	{
+		user_TX("FLOW ON\r\n");
+		return;
+	}
+	// Module that never drives CTS low would otherwise wait on it
+	if (result == ATCMD_RESULT_OK) atcmd_queue("AT&R0\r\n", GAINSPAN_BAUD_WAIT_MS, NULL);
+	user_TX("FLOW OFF\r\n");
+}
+
+
+
+/**
+ * \fn static void main_bulk_done(enum atcmd_results result, char* line)
+ * \brief Shows if the module hands on received UDP data as bulk data.
+ * \param result Callback reason
+ * \param line Response line
+ */
+static void main_bulk_done(enum atcmd_results result, char* line)
+{
+	if (result == ATCMD_RESULT_DATA) return;
+	user_TX((result == ATCMD_RESULT_OK) ? "BULK ON\r\n" : "BULK OFF\r\n");
+}
+
+
+
+/**
+ * \fn static void main_connect_done(enum atcmd_results result, char* line)
+ * \brief Counts commands of connect sequence answered OK.
+ * \param result Callback reason
+ * \param line Response line
+ */
+static void main_connect_done(enum atcmd_results result, char* line)
+{
+	if (result == ATCMD_RESULT_OK) main_connect_ok++;
+}
+
+
+
+/**
+ * \fn static void main_connect_fail(void)
+ * \brief Ends connect attempt and pauses before the next.
+ */
+static void main_connect_fail(void)
+{
+	OUT_LED1_OFF;
+	if (--main_connect_retry > 0)
+	{
+		main_connect_wait = MAIN_CONNECT_PAUSE_MS;
+		main_connect_state = MAIN_CONNECT_PAUSE;
+	}
+	else main_connect_state = MAIN_CONNECT_DONE;
+}
+
+
+
+/**
+ * \fn static void main_connect_tick(void)
+ * \brief Runs connect sequence from the main loop.
+ *
+ * Queues the commands of each step and checks them once all have been answered,
+ * so acquisition and datagrams carry on while the module associates.
+ */
+static void main_connect_tick(void)
+{
+	uint8_t i;
+
+	if (atcmd_busy()) return;
+	switch (main_connect_state)
+	{
+		case MAIN_CONNECT_MODULE:
+			// Get version info
+			main_connect_ok = 0;
+			main_version_i = 0;
+			for (i = 0; i < sizeof(main_version_cmds) / sizeof(main_version_cmds[0]); i++)
+			{
+				atcmd_queue(main_version_cmds[i], GAINSPAN_COMMAND_WAIT_MS, main_version_done);
+			}
+			main_connect_state = MAIN_CONNECT_VERSION;
+			break;
+		case MAIN_CONNECT_VERSION:
+			// Did it work?
+			if (main_connect_ok == sizeof(main_version_cmds) / sizeof(main_version_cmds[0]))
+			{	// Show version data
+				for (i = 0; i < sizeof(main_version_params) / sizeof(main_version_params[0]); i++)
+				{
+					user_TX(main_version_params[i]);
+					user_TX("\r\n");
+				}
+				user_TX("SUCCESS!!\r\n");
+			}
+			else user_TX("FAILED!!\r\n");
+			// Flow control and bulk data are answered before the connect sequence starts
+			atcmd_queue("AT&R1\r\n", GAINSPAN_BAUD_WAIT_MS, main_flow_done);
+			atcmd_queue("AT+BDATA=1\r\n", GAINSPAN_BAUD_WAIT_MS, main_bulk_done);
+			main_connect_wait = MAIN_CONNECT_PAUSE_MS;
+			main_connect_state = MAIN_CONNECT_PAUSE;
+			break;
+		case MAIN_CONNECT_PAUSE:
+			if (main_connect_wait > 0)
+			{
+				main_connect_wait--;
+				break;
+			}
+			// Reset buffer
+			gainspan_RXreset();
+			OUT_LED1_ON;
+			user_TX(MAIN_WIFI_NAME);
+			main_connect_ok = 0;
+			for (i = 0; i < sizeof(main_connect_cmds) / sizeof(main_connect_cmds[0]); i++)
+			{
+				atcmd_queue(main_connect_cmds[i], GAINSPAN_COMMAND_WAIT_MS, main_connect_done);
+			}
+			main_connect_state = MAIN_CONNECT_SETUP;
+			break;
+		case MAIN_CONNECT_SETUP:
+			if (main_connect_ok < sizeof(main_connect_cmds) / sizeof(main_connect_cmds[0]))
+			{
+				main_connect_fail();
+				break;
+			}
+			main_connect_ok = 0;
+			atcmd_queue("AT+NSUDP=8888\r\n", GAINSPAN_COMMAND_WAIT_MS, main_connect_done);
+			main_connect_state = MAIN_CONNECT_UDP;
+			break;
+		case MAIN_CONNECT_UDP:
+			if (main_connect_ok == 0)
+			{
+				main_connect_fail();
+				break;
+			}
+			OUT_LED1_OFF;
+			main_connected = true;
+			main_connect_state = MAIN_CONNECT_DONE;
+			break;
+		default:
+			break;
+	}
+}
+
+
+
+/**
+ * \fn static void main_console_done(enum atcmd_results result, char* line)
+ * \brief Releases console input buffer when its command is answered.
+ * \param result Callback reason
+ * \param line Response line
+ *
+ * Responses reach the console through the GainSpan echo.
+ */
+static void main_console_done(enum atcmd_results result, char* line)
+{
+	if (result == ATCMD_RESULT_DATA) return;
+	if (result == ATCMD_RESULT_TIMEOUT) user_TX("NO RESPONSE!\r\n");
+	// Reset input buffer
+	user_i_rx = 0;
+	// Clear user command indicator
+	user_command_ready = false;
+	main_console_busy = false;
+}
+
+
+
+/**
+ * \fn static bool main_ets(char* p)
+ * \brief Checks fields of `@ets` and starts equivalent-time record.
+ * \param p Fields after `@ets`
+ * \returns false if a field is missing or out of range, the sampler is not touched then
+ */
+static bool main_ets(char* p)
+{
+	uint32_t val[6];
+	uint8_t k;
+
+	// Mask in hex, then channel, level, points, rate and ratio
+	for (k = 0; k < 6; k++)
+	{
+		if ((k > 0) && (*p++ != ',')) return false;
+		val[k] = strtoul(p, &p, (k == 0) ? 16 : 10);
+	}
+	if ((val[0] == 0) || (val[0] >= (1 << SAMPLER_NR_OF_CHANNELS))) return false;
+	if (val[1] >= SAMPLER_NR_OF_CHANNELS) return false;
+	if (val[2] > 0x0FFF) return false;
+	if ((val[3] == 0) || (val[3] > 0xFFFF)) return false;
+	if ((val[4] == 0) || (val[4] > SAMPLER_RATE_MAX)) return false;
+	if ((val[5] == 0) || (val[5] > 0xFF)) return false;
+
+	capture_save();
+	capture_select(val[0]);
+	ets_start(val[1], val[2], val[3], val[4], val[5]);
+	capture_wait();
+	return true;
+}
+#endif
+
+
+
 int main (void)
 {
 	
 	uint32_t msec;
+	uint32_t rate;
+	uint32_t freq;
 	
-	uint8_t oknext;
 	uint16_t val;
+	uint16_t min, max;
+	uint16_t samples[MAIN_READ_SAMPLES];
+	uint8_t n, j;
+	char* p;
 	char ch;
-	uint8_t retry;
-	uint8_t connected;
 	uint16_t switch_debounce;
 	
 	uint16_t i;
 	
-	char buf[32];
+	char buf[64];
 	
 	board_init();
 	sysclk_init();
@@ -82,6 +398,12 @@ int main (void)
 	cpu_irq_enable();
 	
 	hardware_init();
+	calib_init();
+	trigger_init();
+	sampler_init();
+	range_init();
+	wave_init();
+	dds_init();
 	user_init();
 
 
@@ -107,66 +429,19 @@ int main (void)
 	user_mdelay_tick(2000);	
 
 #ifndef USE_NO_WIFI	
-	// Get version info
-	oknext = 0;
-	oknext += gainspan_TXexecute("ATI0\r\n", gainspan_param_module_i0);
-	oknext += gainspan_TXexecute("ATI1\r\n", gainspan_param_module_i1);
-	oknext += gainspan_TXexecute("ATI2\r\n", gainspan_param_module_i2);
-	
-	// Did it work?
-	if (oknext == 3)
-	{	// Show version data
-		user_TX(gainspan_param_module_i0);
-		user_TX("\r\n");
-		user_TX(gainspan_param_module_i1);
-		user_TX("\r\n");
-		user_TX(gainspan_param_module_i2);
-		user_TX("\r\n");
-		user_TX("SUCCESS!!\r\n");
-	}
-	else
-	{
-		user_TX("FAILED!!\r\n");
-		if (oknext >= 10) user_TX("NO RESPONSE!\r\n");
+	// Baud rate waits for each answer, the USART changes rate between its commands
+	if (gainspan_TXexecute_wait("AT\r\n", gainspan_param_debug, GAINSPAN_BAUD_WAIT_MS) == 1)
+	{	// Raise baud rate now the module answers
+		sprintf(buf, "BAUD %lu\r\n", gainspan_negotiate_baud());
+		user_TX(buf);
 	}
+	else user_TX("NO RESPONSE!\r\n");
 
-	// Start connect sequence
-	retry = 3;
-	connected = false;
-	do 
-	{
-		// Pause
-		user_mdelay_tick(1000);
-		// Reset buffer
-		gainspan_RXreset();
-
-		OUT_LED1_ON;
-		oknext = 0;
-		// Start commands
-#ifdef USE_WIFI_JRRSFT
-		user_TX("WIFI_JRRSFT\r\n");
-		oknext += gainspan_TXexecute("AT+WWPA=onestationlane\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+WM=0\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+NDHCP=1\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+WA=jrrsft\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+NSTAT=?\r\n", gainspan_param_module);
-		if (oknext == 5) oknext += gainspan_TXexecute("AT+NSUDP=8888\r\n", gainspan_param_module);
-		if (oknext > 5)	connected = true;
-#endif
-#ifdef USE_WIFI_AP_CEDRIC
-		user_TX("WIFI_AP_CEDRIC\r\n");
-		oknext += gainspan_TXexecute("AT+WRXACTIVE=1\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+WSEC=1\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+WM=2\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+DHCPSRVR=1\r\n", gainspan_param_module);
-		oknext += gainspan_TXexecute("AT+WA=Cedric\r\n", gainspan_param_module);
-		if (oknext == 5) oknext += gainspan_TXexecute("AT+NSUDP=8888\r\n", gainspan_param_module);
-		if (oknext > 5)	connected = true;
-#endif
-		
-		OUT_LED1_OFF;
-	} 
-	while ((!connected) && (--retry > 0));
+	// Version, flow control and connect sequence run from the main loop
+	main_connect_retry = MAIN_CONNECT_RETRIES;
+	main_connect_state = MAIN_CONNECT_MODULE;
+	main_connected = false;
+	main_console_busy = false;
 #else
 	user_TX("USE_NO_WIFI\r\n");
 #endif
@@ -212,21 +487,25 @@ int main (void)
 		}	
 		
 #else
-		if (user_command_ready)
+		atcmd_tick();
+		main_connect_tick();
+		// Follow signal level, sends nothing so runs while associating
+		range_tick();
+		if (user_command_ready && !main_console_busy)
 		{
-			// Send to Gainspan
+			// Send to Gainspan, buffer is released by main_console_done()
 			user_buf_rx[user_i_rx++] = 10;
 			user_buf_rx[user_i_rx++] = 13;
 			user_buf_rx[user_i_rx] = 0;
-			gainspan_TXexecute(user_buf_rx, gainspan_param_module);
-	
-			// Reset input buffer
-			user_i_rx = 0;
-			// Clear user command indicator
-			user_command_ready = false;
+			main_console_busy = atcmd_queue(user_buf_rx, GAINSPAN_COMMAND_WAIT_MS, main_console_done);
+			if (!main_console_busy)
+			{	// Queue full, drop command
+				user_i_rx = 0;
+				user_command_ready = false;
+			}
 		}
 		// Flash LED
-		if (connected)
+		if (main_connected)
 		{
 			
 			msec++;
@@ -242,11 +521,24 @@ int main (void)
 				// Process data
 				if (gainspan_param_module[0] == '@')
 				{	
-					if (strncmp(gainspan_param_module, "@adc", 4) == 0)
+					if (strncmp(gainspan_param_module, "@adcm", 5) == 0)
+					{	// Lowest and highest reading since last request
+						ch = gainspan_param_module[5];
+						if ((ch >= '0') && (ch < '0' + SAMPLER_NR_OF_CHANNELS))
+						{
+							sampler_read_minmax(ch - '0', &min, &max);
+							sprintf(buf,"ADCM%c:%u:%u",ch,min,max);
+							gainspan_TXdata(buf);
+							user_TX(buf);
+							user_TX("\r\n");
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@adc", 4) == 0)
 					{	// Read from ADC
 						ch = gainspan_param_module[4];
 						val = hardware_read_adc((int)(ch));
-						sprintf(buf,"ADC%c:%d",ch,val);
+						if (range_auto) sprintf(buf,"ADC%c:%u:%lu",ch,val,range_scale_nv(ch - '0'));
+						else sprintf(buf,"ADC%c:%u",ch,val);
 						gainspan_TXdata(buf);
 						user_TX(buf);
 						user_TX("\r\n");
@@ -254,16 +546,359 @@ int main (void)
 					else if (strncmp(gainspan_param_module, "@dac", 4) == 0)
 					{	// Set DAC
 						ch = gainspan_param_module[4];
-						val = (int)(gainspan_param_module[6]);
-						if (val > 'a' && val < 'z') 
+						if (((ch == '0') || (ch == '1')) && (gainspan_param_module[5] == ','))
 						{
-							val -= (int)('a')*10;
+							val = strtoul(&gainspan_param_module[6], NULL, 10);
+							if (val > 4095) val = 4095;
+							wave_stop(ch - '0');
 							hardware_write_dac(ch, val);
 							sprintf(buf,"DAC%c:%d",ch, val);
 							user_TX(buf);
 							user_TX("\r\n");
 						}
 					}
+					else if (strncmp(gainspan_param_module, "@dv", 3) == 0)
+					{	// Set both DAC channels together, 3 hex digits each or --- to leave
+						n = 0;
+						for (j = 0; j < WAVE_NR_OF_CHANNELS; j++)
+						{
+							p = &gainspan_param_module[3 + (3 * j)];
+							if (strncmp(p, "---", 3) == 0) continue;
+							if (hardware_read_hex(p, 3) < 0) break;
+							samples[j] = hardware_read_hex(p, 3);
+							n |= (1 << j);
+						}
+						if (j >= WAVE_NR_OF_CHANNELS)
+						{
+							p = &gainspan_param_module[3 + (3 * WAVE_NR_OF_CHANNELS)];
+							val = (*p == ',') ? strtoul(p + 1, NULL, 10) : 0;
+							wave_set_outputs(n, samples, val);
+							sprintf(buf,"DV:%d:%d:%u",(n & 1) ? samples[0] : -1,(n & 2) ? samples[1] : -1,val);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@os", 3) == 0)
+					{	// Set oversampling of channel
+						ch = gainspan_param_module[3];
+						if ((ch >= '0') && (ch < '0' + SAMPLER_NR_OF_CHANNELS) && (gainspan_param_module[4] == ','))
+						{
+							sampler_set_oversampling(ch - '0', atoi(&gainspan_param_module[5]));
+							sprintf(buf,"OS%c:%d",ch,sampler_os[ch - '0']);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@calsave", 8) == 0)
+					{	// Keep coefficients in EEPROM
+						calib_save();
+						gainspan_TXdata("CALSAVE");
+					}
+					else if (strncmp(gainspan_param_module, "@calf", 5) == 0)
+					{	// Factory calibration
+						sprintf(buf,"CALF:%u",calib_factory);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@cal", 4) == 0)
+					{	// Read or set offset and gain of channel
+						ch = gainspan_param_module[4];
+						if ((ch >= '0') && (ch < '0' + SAMPLER_NR_OF_CHANNELS))
+						{
+							if (gainspan_param_module[5] == ',')
+							{
+								val = strtol(&gainspan_param_module[6], &p, 10);
+								if (*p == ',') calib_set(ch - '0', val, strtoul(p + 1, &p, 10));
+							}
+							sprintf(buf,"CAL%c:%d:%u",ch,calib[ch - '0'].offset,calib[ch - '0'].gain);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@peak", 5) == 0)
+					{	// Peak detect at highest rate
+						sampler_set_peak(atoi(&gainspan_param_module[5]));
+						if (sampler_peak > 1) sampler_start(SAMPLER_MODE_TIMED, SAMPLER_RATE_MAX);
+						sprintf(buf,"PEAK:%u:%lu",sampler_peak,sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@free", 5) == 0)
+					{	// Free running sweeps, cache only
+						sampler_nr_of_ch = SAMPLER_NR_OF_CHANNELS;
+						sampler_start(SAMPLER_MODE_FREERUN, atol(&gainspan_param_module[5]));
+						sprintf(buf,"FREE:%lu",sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@dma", 4) == 0)
+					{	// Timer triggered sweeps copied by DMA
+						sampler_nr_of_ch = SAMPLER_NR_OF_CHANNELS;
+						sampler_start(SAMPLER_MODE_DMA, atol(&gainspan_param_module[4]));
+						sprintf(buf,"DMA:%lu",sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@timed", 6) == 0)
+					{	// Timer triggered sweeps
+						sampler_nr_of_ch = SAMPLER_NR_OF_CHANNELS;
+						sampler_start(SAMPLER_MODE_TIMED, atol(&gainspan_param_module[6]));
+						sprintf(buf,"TIMED:%lu",sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@trig", 5) == 0)
+					{	// Set trigger and arm
+						trigger_conf.ch = strtoul(&gainspan_param_module[5], &p, 10);
+						if (*p == ',') p++;
+						if (*p == 'r') trigger_conf.type = TRIGGER_TYPE_RISING;
+						else if (*p == 'f') trigger_conf.type = TRIGGER_TYPE_FALLING;
+						else if (*p == 'a') trigger_conf.type = TRIGGER_TYPE_ABOVE;
+						else if (*p == 'b') trigger_conf.type = TRIGGER_TYPE_BELOW;
+						else if (*p == 'n') trigger_conf.type = TRIGGER_TYPE_NONE;
+						if (*p != 0) p++;
+						if (*p == ',') trigger_conf.level = strtoul(p + 1, &p, 10);
+						if (*p == ',') trigger_conf.hyst = strtoul(p + 1, &p, 10);
+						if (*p == ',') trigger_conf.pre = strtoul(p + 1, &p, 10);
+						if (*p == ',') trigger_conf.holdoff = strtoul(p + 1, &p, 10);
+						trigger_conf.length = 0;
+						if (*p == ',') trigger_conf.length = strtoul(p + 1, &p, 10);
+						trigger_arm();
+						sprintf(buf,"TRIG:%d",trigger_state);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@tarm", 5) == 0)
+					{	// Arm with same settings
+						trigger_arm();
+						sprintf(buf,"TRIG:%d",trigger_state);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@toff", 5) == 0)
+					{	// Disarm
+						trigger_disarm();
+						sprintf(buf,"TRIG:%d",trigger_state);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@tstat", 6) == 0)
+					{	// Trigger state and captured window
+						sprintf(buf,"TSTAT:%d:%u:%u",trigger_state,trigger_get_length(),trigger_get_position());
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@tread", 6) == 0)
+					{	// Samples from captured window
+						i = atoi(&gainspan_param_module[6]);
+						n = trigger_read(i, samples, MAIN_READ_SAMPLES);
+						p = buf + sprintf(buf,"TREAD%u:",i);
+						for (j = 0; j < n; j++)
+						{
+							p += sprintf(p,"%u,",samples[j]);
+						}
+						if (n > 0) p[-1] = 0;
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@capbin", 7) == 0)
+					{	// Sample format of later datagrams, before @cap as b is a hex digit
+						capture_binary = (atoi(&gainspan_param_module[7]) != 0);
+						sprintf(buf,"CAPBIN:%u",capture_binary);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@cap", 4) == 0)
+					{	// Capture block, samples are sent by capture_tick()
+						ch = strtoul(&gainspan_param_module[4], &p, 16);
+						i = 0;
+						if (*p == ',') i = strtoul(p + 1, &p, 10);
+						if (*p == ',') capture_start(ch, i, strtoul(p + 1, &p, 10));
+					}
+					else if (strncmp(gainspan_param_module, "@ets", 4) == 0)
+					{	// Equivalent-time record, sent by capture_tick() when complete
+						if (main_ets(&gainspan_param_module[4])) sprintf(buf,"ETS:%u:%lu",trigger_conf.length,ets_rate);
+						else sprintf(buf,"ETS:0:0");
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@res", 4) == 0)
+					{	// ADC resolution, restarts current mode
+						sampler_set_resolution(atoi(&gainspan_param_module[4]));
+						sprintf(buf,"RES:%u:%lu",sampler_bits,sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@ilchk", 6) == 0)
+					{	// Order check of last interleaved burst
+						sprintf(buf,"ILCHK:%u:%u:%u:%u:%u:%u:%u:%u:%u",sampler_il_errors,
+							sampler_il_step[0],sampler_il_step[1],sampler_il_step[2],sampler_il_step[3],
+							sampler_il_mean[0],sampler_il_mean[1],sampler_il_mean[2],sampler_il_mean[3]);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@il", 3) == 0)
+					{	// Interleaved burst of one pin, samples are sent by capture_tick()
+						ch = strtoul(&gainspan_param_module[3], &p, 10);
+						if (*p == ',')
+						{
+							capture_start_interleaved(ch, strtoul(p + 1, &p, 10));
+							sprintf(buf,"IL%u:%lu",sampler_il_ch,sampler_rate);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@wv", 3) == 0)
+					{	// Write points into DAC table
+						ch = strtoul(&gainspan_param_module[3], &p, 10);
+						i = 0;
+						if (*p == ',') i = strtoul(p + 1, &p, 10);
+						n = 0;
+						while ((*p == ',') && (n < MAIN_READ_SAMPLES)) samples[n++] = strtoul(p + 1, &p, 10);
+						sprintf(buf,"WV%u:%u:%u",ch,i,wave_write(ch, i, samples, n));
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@wrate", 6) == 0)
+					{	// Point rate of both DAC channels
+						sprintf(buf,"WRATE:%lu",wave_set_rate(atol(&gainspan_param_module[6])));
+						gainspan_TXdata(buf);
+					}
+					else if ((strncmp(gainspan_param_module, "@wplay", 6) == 0) || (strncmp(gainspan_param_module, "@wstop", 6) == 0))
+					{	// Start or stop DAC table playback
+						ch = strtoul(&gainspan_param_module[6], &p, 10);
+						if (ch < WAVE_NR_OF_CHANNELS)
+						{
+							if (gainspan_param_module[2] == 's') wave_stop(ch);
+							else if ((p[0] == ',') && ((p[1] == 'l') || (p[1] == 'o')))
+							{
+								i = 0;
+								if (p[2] == ',') i = atoi(&p[3]);
+								wave_start(ch, (p[1] == 'l') ? WAVE_MODE_LOOP : WAVE_MODE_ONESHOT, i);
+							}
+							sprintf(buf,"WAVE%u:%d:%u:%lu",ch,wave_ch[(uint8_t)ch].mode,wave_ch[(uint8_t)ch].len,wave_rate);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@dds", 4) == 0)
+					{	// DDS generator of DAC channel, restarted in phase with the other generating channel
+						ch = strtoul(&gainspan_param_module[4], &p, 10);
+						if ((ch < WAVE_NR_OF_CHANNELS) && (p[0] == ',') && (p[2] == ','))
+						{
+							if (p[1] == 't') dds_conf[(uint8_t)ch].shape = DDS_SHAPE_TRIANGLE;
+							else if (p[1] == 'q') dds_conf[(uint8_t)ch].shape = DDS_SHAPE_SQUARE;
+							else dds_conf[(uint8_t)ch].shape = DDS_SHAPE_SINE;
+							dds_conf[(uint8_t)ch].freq = strtoul(p + 3, &p, 10);
+							if (*p == ',') dds_conf[(uint8_t)ch].phase = strtoul(p + 1, &p, 10);
+							if (*p == ',') dds_conf[(uint8_t)ch].amplitude = strtoul(p + 1, &p, 10);
+							if (*p == ',') dds_conf[(uint8_t)ch].offset = strtoul(p + 1, &p, 10);
+							n = (1 << ch);
+							for (j = 0; j < WAVE_NR_OF_CHANNELS; j++)
+							{
+								if (wave_ch[j].mode == WAVE_MODE_DDS) n |= (1 << j);
+							}
+							dds_start(n);
+							sprintf(buf,"DDS%u:%d:%lu:%lu",ch,dds_conf[(uint8_t)ch].shape,dds_get_freq(ch),wave_rate);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@wb", 3) == 0)
+					{	// Start chunked table upload
+						ch = strtoul(&gainspan_param_module[3], &p, 10);
+						n = 0;
+						if (*p == ',')
+						{
+							n = strtoul(p + 1, &p, 10);
+							if (!upload_begin(ch, n)) n = 0;
+						}
+						sprintf(buf,"WB%u:%u",ch,n);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@wu", 3) == 0)
+					{	// Chunk of table upload, acknowledged with points written
+						sprintf(buf,"WU%.2s:%u",&gainspan_param_module[3],upload_chunk(&gainspan_param_module[3]));
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@wm", 3) == 0)
+					{	// Points of table upload received
+						p = buf + sprintf(buf,"WM%u:%u/%u:",upload_ch,upload_count(),upload_len);
+						for (j = 0; j < sizeof(upload_got); j++) p += sprintf(p,"%02X",upload_got[j]);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@wc", 3) == 0)
+					{	// Commit table upload
+						n = upload_len;
+						j = upload_commit(strtoul(&gainspan_param_module[3], NULL, 16));
+						sprintf(buf,"WC%u:%u:%u",upload_ch,n,j);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@bode", 5) == 0)
+					{	// Frequency response sweep, results follow as each frequency is measured
+						ch = strtoul(&gainspan_param_module[5], &p, 10);
+						n = 0;
+						if (*p == ',')
+						{
+							i = strtoul(p + 1, &p, 10);
+							if (*p == ',')
+							{
+								j = strtoul(p + 1, &p, 10);
+								if (*p == ',')
+								{
+									rate = strtoul(p + 1, &p, 10);
+									if (*p == ',')
+									{
+										freq = strtoul(p + 1, &p, 10);
+										if (*p == ',')
+										{	// More than 255 frequencies is refused, not wrapped
+											val = strtoul(p + 1, &p, 10);
+											n = bode_start(ch, i, j, rate, freq, (val > 0xFF) ? 0 : val);
+										}
+									}
+								}
+							}
+						}
+						sprintf(buf,"BODE:%u",n);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@bstop", 6) == 0)
+					{	// Abandon frequency response sweep
+						bode_stop();
+						sprintf(buf,"BODE:0");
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@sync", 5) == 0)
+					{	// ADC sweeps started by the DAC timer at an offset after each DAC update
+						n = strtoul(&gainspan_param_module[5], &p, 10);
+						val = wave_set_offset((*p == ',') ? strtoul(p + 1, &p, 10) : wave_offset_us);
+						sampler_set_sync(n);
+						sprintf(buf,"SYNC:%u:%u:%lu",sampler_sync,val,sampler_sync ? wave_rate : sampler_rate);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@alarm", 6) == 0)
+					{	// Level or window alarm of channel
+						ch = strtoul(&gainspan_param_module[6], &p, 10);
+						if ((ch < SAMPLER_NR_OF_CHANNELS) && (*p == ','))
+						{
+							p++;
+							if ((*p == 'a') || (*p == 'b'))
+							{
+								i = (*p == 'a') ? ALARM_TYPE_ABOVE : ALARM_TYPE_BELOW;
+								if (p[1] == ',')
+								{
+									val = strtoul(p + 2, &p, 10);
+									alarm_set(ch, i, val, val);
+								}
+							}
+							else if ((*p == 'i') || (*p == 'o'))
+							{
+								i = (*p == 'i') ? ALARM_TYPE_INSIDE : ALARM_TYPE_OUTSIDE;
+								if (p[1] == ',')
+								{
+									val = strtoul(p + 2, &p, 10);
+									if (*p == ',') alarm_set(ch, i, val, strtoul(p + 1, &p, 10));
+								}
+							}
+							else if (*p == 'n') alarm_set(ch, ALARM_TYPE_OFF, 0, 0);
+							sprintf(buf,"ALARMSET%u:%d",ch,alarm_conf[(uint8_t)ch].type);
+							gainspan_TXdata(buf);
+						}
+					}
+					else if (strncmp(gainspan_param_module, "@range", 6) == 0)
+					{	// Auto ranging on or off
+						range_set_auto(gainspan_param_module[6] == '1');
+						sprintf(buf,"RANGE:%u",range_auto);
+						gainspan_TXdata(buf);
+					}
+					else if (strncmp(gainspan_param_module, "@scale", 6) == 0)
+					{	// Gain, reference and scale of channel
+						ch = gainspan_param_module[6];
+						if ((ch >= '0') && (ch < '0' + SAMPLER_NR_OF_CHANNELS))
+						{
+							sprintf(buf,"SCALE%c:%u:%u:%lu",ch,1 << range_gain[ch - '0'],range_ref_mv(),range_scale_nv(ch - '0'));
+							gainspan_TXdata(buf);
+						}
+					}
 					else if (strncmp(gainspan_param_module, "@echo", 5) == 0)
 					{	// Echo test message
 						gainspan_TXdata("ECHO");
@@ -272,6 +907,13 @@ int main (void)
 				}
 			}
 			
+			// Send captured block
+			capture_tick();
+			// Notify tripped alarms
+			alarm_tick();
+			// Measure and send frequency response
+			bode_tick();
+			
 			// Button pressed?
 			if (IN_SWITCH_DOWN)
 			{	// Send when button released
@@ -290,7 +932,8 @@ int main (void)
 				}
 			}
 		}
-		else OUT_LED1_OFF;		
+		// Not connected, pass AT responses on
+		else gainspan_RXdata(gainspan_param_module);
 #endif
 	}	
 }
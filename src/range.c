@@ -0,0 +1,264 @@
+/**
+ * \file range.c
+ * \brief Automatic ranging of ADC channels
+ *
+ * Picks the gain of each ADC channel and the ADC reference from the highest results
+ * seen recently so small signals use more of the converter range. Results are
+ * reported together with their scale so they can be converted to volts.
+ *
+ * Additional information can be found in the [Range Guide](\ref RangeGuide) page.
+ *
+ */
+
+/**
+ * \page RangeGuide Range Guide
+ *
+ * Operation
+ * - The channel gain stage (1x to 64x) is only available for differential inputs, so when auto
+ *   ranging is on each channel is converted differentially against pad ground in signed mode
+ * - Signed results have one bit less for positive inputs, full scale is 2047 instead of 4095 (127 instead of 255 in 8 bit mode)
+ * - Calibration coefficients are measured single ended and are not applied while auto ranging,
+ *   results are limited to the signed full scale (scaled with oversampling) instead
+ * - Every \ref RANGE_PERIOD main loop ticks the highest result of each channel in the sweep is checked
+ * - Above 15/16 of full scale the gain of the channel is halved, below 7/16 it is doubled
+ * - A channel over range at 1x moves the reference up, a channel under range at 64x moves it
+ *   down if all channels still fit below 7/8 of full scale with the lower reference
+ * - The reference is shared by all channels, gains are per channel
+ * - References are internal 1.0V, VCC/1.6 and `VREF` (only when \ref RANGE_AREF_MV is set)
+ * - The sampler is restarted after a change, so the cache and blocks only hold results of one range
+ *
+ * The range is not changed while the trigger is armed, a capture is being sent or in
+ * equivalent-time mode, so a record always has one scale. Trigger and comparator levels are in
+ * ADC counts and are not rescaled.
+ *
+ * Scale
+ * - `<nV>` is the input voltage of one result count in nV: `reference / (2048 * gain)` with
+ *   auto ranging and `reference / 4096` without, divided again by 2 for each oversampling bit
+ * - In 8 bit mode 2048 and 4096 become 128 and 256
+ *
+ * UDP commands
+ * - `@range1` turns auto ranging on, `@range0` returns to single ended 1x with VCC/1.6 reference, replies `RANGE:<on>`
+ * - `@scale<ch>` replies `SCALE<ch>:<gain>:<reference mV>:<nV>`
+ * - `@adc<ch>` replies `ADC<ch>:<value>:<nV>` when auto ranging is on
+ * - The first `CAP` datagram of a capture has `;<nV>` for each selected channel after the header
+ *
+ * Defined in \ref range.c
+ */
+
+
+#include <asf.h>
+
+#include "hardware.h"
+#include "sampler.h"
+#include "trigger.h"
+#include "capture.h"
+#include "range.h"
+
+
+static uint16_t range_count;	/**< Main loop ticks since last range decision */
+
+
+
+/**
+ * \fn static enum range_refs range_ref_top(void)
+ * \brief Returns highest reference available.
+ * \returns `VREF` when fitted, otherwise VCC/1.6
+ */
+static enum range_refs range_ref_top(void)
+{
+	if (RANGE_AREF_MV > 0) return RANGE_REF_AREF;
+	return RANGE_REF_VCC;
+}
+
+
+
+/**
+ * \fn static uint16_t range_mv(enum range_refs ref)
+ * \brief Returns voltage of reference.
+ * \param ref Reference
+ * \returns Voltage in mV
+ */
+static uint16_t range_mv(enum range_refs ref)
+{
+	if (ref == RANGE_REF_BANDGAP) return RANGE_BANDGAP_MV;
+	if (ref == RANGE_REF_AREF) return RANGE_AREF_MV;
+	return (RANGE_VCC_MV * 10UL) / 16;
+}
+
+
+
+/**
+ * \fn static void range_apply(void)
+ * \brief Writes reference and channel inputs to the ADC.
+ *
+ * A running sampler is restarted so no result is mixed with the previous range.
+ */
+static void range_apply(void)
+{
+	struct adc_config adc_conf;
+	struct adc_channel_config adcch_conf;
+	enum adc_reference ref;
+	uint8_t ch;
+
+	// Interleaved burst would restore the old inputs when it ends
+	if (sampler_mode == SAMPLER_MODE_INTERLEAVED) sampler_stop();
+
+	if (range_ref == RANGE_REF_BANDGAP) ref = ADC_REF_BANDGAP;
+	else if (range_ref == RANGE_REF_AREF) ref = ADC_REF_AREFA;
+	else ref = ADC_REF_VCC;
+
+	adc_read_configuration(&ADCA, &adc_conf);
+	adc_set_conversion_parameters(&adc_conf, range_auto ? ADC_SIGN_ON : ADC_SIGN_OFF, (sampler_bits == 8) ? ADC_RES_8 : ADC_RES_12, ref);
+	adc_write_configuration(&ADCA, &adc_conf);
+
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+	{	// Gain stage needs differential input
+		adcch_read_configuration(&ADCA, (1 << ch), &adcch_conf);
+		if (range_auto) adcch_set_input(&adcch_conf, ADCCH_POS_PIN1 + ch, ADCCH_NEG_PAD_GND, 1 << range_gain[ch]);
+		else adcch_set_input(&adcch_conf, ADCCH_POS_PIN1 + ch, ADCCH_NEG_NONE, 1);
+		adcch_write_configuration(&ADCA, (1 << ch), &adcch_conf);
+	}
+
+	if ((sampler_mode != SAMPLER_MODE_OFF) && (sampler_mode != SAMPLER_MODE_ETS)) sampler_start(sampler_mode, sampler_rate);
+}
+
+
+
+/**
+ * \fn void range_init(void)
+ * \brief Starts with auto ranging off.
+ *
+ * Must be called after sampler_init().
+ */
+void range_init(void)
+{
+	range_set_auto(0);
+}
+
+
+
+/**
+ * \fn void range_set_auto(uint8_t on)
+ * \brief Turns auto ranging on or off.
+ * \param on Non zero to turn on
+ *
+ * Auto ranging starts from 1x with VCC/1.6 reference. Turning off returns all channels
+ * to single ended unsigned conversions with VCC/1.6 reference.
+ */
+void range_set_auto(uint8_t on)
+{
+	uint8_t ch;
+
+	range_auto = on;
+	range_ref = RANGE_REF_VCC;
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++) range_gain[ch] = 0;
+	range_count = 0;
+	range_apply();
+}
+
+
+
+/**
+ * \fn void range_tick(void)
+ * \brief Checks signal peaks and changes range.
+ *
+ * Called from main loop. Decides every \ref RANGE_PERIOD ticks from the highest result
+ * of each channel since the last decision.
+ */
+void range_tick(void)
+{
+	uint32_t fs;
+	uint32_t peak[SAMPLER_NR_OF_CHANNELS];
+	uint8_t ch;
+	uint8_t changed;
+	uint8_t up;
+	uint8_t down;
+
+	if (!range_auto) return;
+	if (++range_count < RANGE_PERIOD) return;
+	range_count = 0;
+
+	// Keep one scale for a whole record
+	if ((sampler_mode == SAMPLER_MODE_OFF) || (sampler_mode == SAMPLER_MODE_ETS) || (sampler_mode == SAMPLER_MODE_INTERLEAVED)) return;
+	if ((trigger_state == TRIGGER_STATE_ARMED) || (trigger_state == TRIGGER_STATE_TRIGGERED)) return;
+	if (capture_state != CAPTURE_STATE_IDLE) return;
+
+	changed = 0;
+	up = 0;
+	down = 0;
+	for (ch = 0; ch < sampler_nr_of_ch; ch++)
+	{
+		fs = (1UL << (sampler_bits - 1)) << sampler_os[ch];
+		peak[ch] = sampler_read_peak(ch);
+		if (peak[ch] >= (fs - (fs / 16)))
+		{	// Over range
+			if (range_gain[ch] > 0)
+			{
+				range_gain[ch]--;
+				changed = 1;
+			}
+			else up = 1;
+		}
+		else if (peak[ch] < ((fs * 7) / 16))
+		{	// Under range
+			if (range_gain[ch] < RANGE_GAIN_MAX)
+			{
+				range_gain[ch]++;
+				changed = 1;
+			}
+			else down = 1;
+		}
+	}
+
+	if (up && (range_ref < range_ref_top()))
+	{
+		range_ref++;
+		changed = 1;
+	}
+	else if (down && !up && (range_ref > RANGE_REF_BANDGAP))
+	{	// Every channel must still fit with the lower reference
+		for (ch = 0; ch < sampler_nr_of_ch; ch++)
+		{
+			fs = (1UL << (sampler_bits - 1)) << sampler_os[ch];
+			if (((peak[ch] * range_mv(range_ref)) / range_mv(range_ref - 1)) >= ((fs * 7) / 8)) down = 0;
+		}
+		if (down)
+		{
+			range_ref--;
+			changed = 1;
+		}
+	}
+
+	if (changed) range_apply();
+}
+
+
+
+/**
+ * \fn uint16_t range_ref_mv(void)
+ * \brief Returns current reference voltage.
+ * \returns Voltage in mV
+ */
+uint16_t range_ref_mv(void)
+{
+	return range_mv(range_ref);
+}
+
+
+
+/**
+ * \fn uint32_t range_scale_nv(uint8_t ch)
+ * \brief Returns input voltage of one result count of channel.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \returns Scale in nV, includes gain and oversampling of channel
+ */
+uint32_t range_scale_nv(uint8_t ch)
+{
+	uint32_t counts;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return 0;
+	if (range_auto) counts = (1UL << (sampler_bits - 1)) << range_gain[ch];
+	else counts = 1UL << sampler_bits;
+	counts <<= sampler_os[ch];
+	return ((uint32_t)range_mv(range_ref) * 1000000UL) / counts;
+}
@@ -0,0 +1,67 @@
+/**
+ * \file range.h
+ * \brief Handles automatic ranging of ADC channels
+ *
+ */
+
+#ifndef RANGE_H
+#define RANGE_H
+
+
+#define RANGE_VCC_MV			3300	/**< Supply voltage in mV, internal reference is VCC/1.6 */
+#define RANGE_BANDGAP_MV		1000	/**< Internal bandgap reference in mV */
+#define RANGE_AREF_MV			0		/**< Voltage on `VREF` pin in mV, 0 when not fitted */
+#define RANGE_GAIN_MAX			6		/**< Highest channel gain as power of two (64x) */
+#define RANGE_PERIOD			200		/**< Main loop ticks between range decisions */
+
+
+enum range_refs
+{
+	RANGE_REF_BANDGAP,
+	RANGE_REF_VCC,
+	RANGE_REF_AREF
+};	/**< ADC reference enumerations, lowest voltage first */
+
+
+uint8_t range_auto;								/**< Non zero when channels are auto ranged */
+enum range_refs range_ref;						/**< Current ADC reference */
+uint8_t range_gain[SAMPLER_NR_OF_CHANNELS];		/**< Current gain of each channel as power of two */
+
+
+
+/**
+ * \fn void range_init(void)
+ * \brief Starts with auto ranging off.
+ */
+void range_init(void);
+
+
+/**
+ * \fn void range_set_auto(uint8_t on)
+ * \brief Turns auto ranging on or off.
+ */
+void range_set_auto(uint8_t on);
+
+
+/**
+ * \fn void range_tick(void)
+ * \brief Checks signal peaks and changes range. Called from main loop.
+ */
+void range_tick(void);
+
+
+/**
+ * \fn uint16_t range_ref_mv(void)
+ * \brief Returns current reference voltage in mV.
+ */
+uint16_t range_ref_mv(void);
+
+
+/**
+ * \fn uint32_t range_scale_nv(uint8_t ch)
+ * \brief Returns input voltage of one result count of channel in nV.
+ */
+uint32_t range_scale_nv(uint8_t ch);
+
+
+#endif // RANGE_H
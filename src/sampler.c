@@ -0,0 +1,947 @@
+/**
+ * \file sampler.c
+ * \brief Background ADC acquisition engine
+ *
+ * Converts ADCA channels without CPU polling. Sweeps are started by a timer overflow
+ * routed through the event system so sample spacing does not depend on the main loop.
+ *
+ * Additional information can be found in the [Sampler Guide](\ref SamplerGuide) page.
+ *
+ */
+
+/**
+ * \page SamplerGuide Sampler Guide
+ *
+ * Timed mode (`SAMPLER_MODE_TIMED`)
+ * - `TCC1` overflow is routed to event channel 0 which starts an ADCA sweep of CH0..CH3
+ * - The completion interrupt of the last channel in the sweep stores all results
+ * - Results are written in channel order into two blocks of \ref SAMPLER_BLOCKSIZE samples
+ * - While the main loop reads one block the interrupt fills the other
+ * - If both blocks are full new samples are dropped and `sampler_overruns` is incremented
+ *
+ * DMA mode (`SAMPLER_MODE_DMA`)
+ * - Sweeps are started by `TCC1` as in timed mode but no ADC interrupt is used
+ * - ADCA requests DMA when all four channels complete, each request moves one 8 byte sweep
+ * - DMA channels 0 and 1 run in double buffer mode, each filling one block, so capture memory is circular
+ * - The DMA block interrupt updates the cache and passes the block on
+ * - A block not released before the DMA returns to it is overwritten and `sampler_overruns` is incremented
+ *
+ * Equivalent-time mode (`SAMPLER_MODE_ETS`)
+ * - Sweeps are started by `TCC1` compare A at a delay after a comparator edge, see the [Equivalent-Time Guide](\ref EtsGuide)
+ *
+ * Interleaved mode (`SAMPLER_MODE_INTERLEAVED`)
+ * - All four ADC channels are switched to the pin of one channel with its gain, so the pipeline
+ *   converts the same input four times in each sweep, each conversion started one ADC clock after the previous
+ * - ADCA sweeps continuously, the ADC clock is the sample rate (limited to \ref SAMPLER_IL_RATE_MAX and
+ *   raised to \ref SAMPLER_ADC_CLOCK_MIN)
+ * - DMA channel 0 copies one burst of \ref SAMPLER_BUFSIZE results, in channel order they are already
+ *   in time order, then the sampler stops and the channel inputs are restored
+ * - The burst is corrected with the pin calibration and passed to the cache, the trigger as one channel sweeps, and both blocks
+ * - No interrupt runs during the burst so the rate is not limited by the CPU
+ *
+ * Interleave check
+ * - `sampler_il_step` is the average step into each result position, from the previous result
+ * - A swapped or skipped channel gives larger steps at two positions, the burst is counted in
+ *   `sampler_il_errors` when the largest step is more than 3/2 of the smallest plus \ref SAMPLER_IL_NOISE
+ * - `sampler_il_mean` is the average of each ADC channel, with a steady input a spread shows offset mismatch between channels
+ * - The step check needs an input changing slowly compared to the sample rate, noise or a steady level also pass
+ *
+ * Synchronised sweeps
+ * - sampler_set_sync() makes timed and DMA mode take their sweeps from `TCC0` compare A, the timer
+ *   clocking the DAC points, in place of `TCC1` overflow
+ * - Each sweep starts the sample offset after a DAC update, with no interrupt or software in the path,
+ *   see the [Waveform Guide](\ref WaveGuide)
+ * - The sweep rate is the DAC point rate, the rate given to sampler_start() is not used
+ *
+ * Free running mode (`SAMPLER_MODE_FREERUN`)
+ * - ADCA sweeps CH0..CH3 continuously, the ADC clock is slowed to give roughly the requested sweep rate
+ * - Only the result cache is updated, no blocks are filled
+ *
+ * An optional callback set with sampler_set_block_callback() is called from interrupt
+ * each time a block completes in timed or DMA mode.
+ *
+ * Oversampling
+ * - Each channel can sum 4^n results (n = 0 to \ref SAMPLER_OS_MAX) and shift right by n giving 12 + n bits
+ * - Extra bits are only meaningful when the input has at least 1 LSB of noise
+ * - In timed mode blocks and trigger get one sweep each time the highest oversampled channel completes
+ * - Free running mode applies oversampling to the cache only, DMA mode always stores 12 bit results
+ *
+ * Peak detect
+ * - In timed mode each bucket of `sampler_peak` sweeps is reduced to a sweep of the lowest and a sweep of the highest results
+ * - The pair is passed to blocks and the trigger in place of the bucket, narrow spikes are not lost
+ * - Sampling at \ref SAMPLER_RATE_MAX with a bucket of 100 gives 100 pairs per second
+ *
+ * 8 bit mode
+ * - sampler_set_resolution() switches ADCA between 12 and 8 bit results at run time
+ * - 8 bit conversions take \ref SAMPLER_CONV_CYCLES_8BIT ADC clocks and the ADC clock is raised
+ *   to \ref SAMPLER_ADC_CLOCK_8BIT, so sweeps complete sooner and free running mode is faster
+ * - Oversampling is turned off, results stay 8 bits so the trigger ring stores one byte each
+ *   and holds twice as many samples, `CAP` datagrams use 2 hex digits per sample
+ * - DMA blocks still hold one word per result as the DMA copies the result registers
+ * - Trigger levels are in 8 bit counts, calibration coefficients stay in 12 bit counts
+ *
+ * Every result is corrected with the offset and gain of its channel before it is
+ * cached or stored, see the [Calibration Guide](\ref CalibrationGuide).
+ *
+ * Each sweep in timed and DMA mode is also passed to trigger_sweep(), see the
+ * [Trigger Guide](\ref TriggerGuide).
+ *
+ * Channels with an alarm are checked with each result, see the [Alarm Guide](\ref AlarmGuide).
+ *
+ * In all modes `sampler_cache` holds the latest, lowest and highest result of each channel
+ * so `@adc` can be answered without starting a conversion.
+ *
+ * Channel pins
+ * - CH0 --> `ADC1`, CH1 --> `ADC2`, CH2 --> `ADC3`, CH3 --> `ADC4`
+ *
+ * UDP commands
+ * - `@timed<rate>` starts timed mode at `<rate>` sweeps per second
+ * - `@dma<rate>` starts DMA mode at `<rate>` sweeps per second
+ * - `@free<rate>` starts free running mode at roughly `<rate>` sweeps per second, replies `FREE:<rate>` with the rate
+ *   obtained, below \ref SAMPLER_ADC_CLOCK_MIN divided by the conversion clocks of a sweep it runs timed mode instead
+ * - `@adc<ch>` replies `ADC<ch>:<latest>`
+ * - `@os<ch>,<n>` sets oversampling of channel to 4^n, replies `OS<ch>:<n>`
+ * - `@peak<bucket>` sets peak detect bucket and restarts timed mode at \ref SAMPLER_RATE_MAX, `@peak0` turns off, replies `PEAK:<bucket>:<rate>`
+ * - `@adcm<ch>` replies `ADCM<ch>:<min>:<max>` and restarts tracking
+ * - `@il<ch>,<rate>` captures one interleaved burst of channel pin at `<rate>` samples per second,
+ *   replies `IL<ch>:<rate>` and sends `CAP` datagrams, see the [Capture Guide](\ref CaptureGuide)
+ * - `@res8` and `@res12` set the ADC resolution and restart the current mode, reply `RES:<bits>:<rate>`
+ * - `@ilchk` replies `ILCHK:<errors>:<step0>:<step1>:<step2>:<step3>:<mean0>:<mean1>:<mean2>:<mean3>`
+ *
+ * Defined in \ref sampler.c
+ */
+
+
+#include <asf.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "sampler.h"
+#include "calib.h"
+#include "ets.h"
+#include "trigger.h"
+#include "alarm.h"
+#include "wave.h"
+
+
+static uint16_t sampler_buf[SAMPLER_BUFSIZE];	/**< Capture memory, two blocks */
+
+static uint8_t sampler_block_len;		/**< Samples in a block, whole sweeps only */
+static volatile uint8_t sampler_i;		/**< Index in block being filled */
+static volatile uint8_t sampler_fill;	/**< Block being filled by interrupt */
+static volatile uint8_t sampler_full;	/**< Bit mask of completed blocks */
+static uint8_t sampler_read;			/**< Block next returned to consumer */
+static sampler_block_callback_t sampler_block_callback;	/**< Called when block completes */
+
+static uint32_t sampler_acc[SAMPLER_NR_OF_CHANNELS];	/**< Oversampling accumulators */
+static uint16_t sampler_sweep[SAMPLER_NR_OF_CHANNELS];	/**< Latest decimated sweep */
+static uint16_t sampler_os_count;		/**< Sweeps since highest oversampling channel completed */
+static uint8_t sampler_os_max;			/**< Highest oversampling of any channel */
+static uint16_t sampler_peak_min[SAMPLER_NR_OF_CHANNELS];	/**< Lowest results in peak detect bucket */
+static uint16_t sampler_peak_max[SAMPLER_NR_OF_CHANNELS];	/**< Highest results in peak detect bucket */
+static uint16_t sampler_peak_count;		/**< Sweeps in current peak detect bucket */
+static struct adc_channel_config sampler_il_saved[SAMPLER_NR_OF_CHANNELS];	/**< Channel inputs restored after interleaved burst */
+
+
+
+/**
+ * \fn static void sampler_store(uint16_t val)
+ * \brief Stores sample in block being filled.
+ * \param val Sample to store
+ *
+ * Called from interrupt.
+ */
+static inline void sampler_store(uint16_t val)
+{
+	// Block still held by consumer?
+	if (sampler_full & (1 << sampler_fill)) return;
+	sampler_buf[(sampler_fill * SAMPLER_BLOCKSIZE) + sampler_i] = val;
+	if (++sampler_i >= sampler_block_len)
+	{	// Block complete, pass to consumer and fill other block
+		sampler_full |= (1 << sampler_fill);
+		if (sampler_block_callback) 
+		{
+			sampler_block_callback(&sampler_buf[sampler_fill * SAMPLER_BLOCKSIZE], sampler_block_len);
+		}
+		sampler_fill ^= 1;
+		sampler_i = 0;
+		// Other block not released yet?
+		if (sampler_full & (1 << sampler_fill)) sampler_overruns++;
+	}
+}
+
+
+
+/**
+ * \fn static void sampler_emit(uint16_t* sweep)
+ * \brief Passes sweep to blocks and trigger.
+ * \param sweep Results in channel order
+ *
+ * Called from interrupt.
+ */
+static void sampler_emit(uint16_t* sweep)
+{
+	uint8_t ch;
+
+	for (ch = 0; ch < sampler_nr_of_ch; ch++) sampler_store(sweep[ch]);
+	trigger_sweep(sweep);
+}
+
+
+
+/**
+ * \fn static void sampler_adc_callback(ADC_t *adc, uint8_t ch_mask, adc_result_t res)
+ * \brief Called when last channel in sweep completes.
+ * \param adc ADC module
+ * \param ch_mask Channel that completed
+ * \param res Result of channel that completed
+ *
+ * Earlier channels in the sweep have already completed so their results are read
+ * directly from the result registers. Oversampled channels are accumulated and only
+ * update the cache when 4^n results have been summed. A sweep is passed on when
+ * the channel with the highest oversampling completes, other channels repeat their
+ * last decimated result. With peak detect each bucket is passed on as a sweep of
+ * lowest results followed by a sweep of highest results.
+ */
+static void sampler_adc_callback(ADC_t *adc, uint8_t ch_mask, adc_result_t res)
+{
+	uint8_t ch;
+	uint8_t os;
+	uint16_t val;
+
+	sampler_os_count++;
+	for (ch = 0; ch < sampler_nr_of_ch; ch++)
+	{
+		if ((1 << ch) == ch_mask) val = res;
+		else val = adc_get_result(adc, (1 << ch));
+		// Signed mode when auto ranging, input is never below ground
+		if (val & 0x8000) val = 0;
+		os = sampler_os[ch];
+		if (os)
+		{	// Decimate when 4^n results have been summed
+			sampler_acc[ch] += val;
+			if (sampler_os_count & ((1 << (2 * os)) - 1)) continue;
+			val = sampler_acc[ch] >> os;
+			sampler_acc[ch] = 0;
+		}
+		val = calib_apply(ch, val, os);
+		sampler_sweep[ch] = val;
+		// Update cache
+		sampler_cache[ch].latest = val;
+		if (val < sampler_cache[ch].min) sampler_cache[ch].min = val;
+		if (val > sampler_cache[ch].max) sampler_cache[ch].max = val;
+		if (val > sampler_cache[ch].peak) sampler_cache[ch].peak = val;
+		if (alarm_conf[ch].type != ALARM_TYPE_OFF) alarm_check(ch, val);
+	}
+
+	// Highest oversampling channel complete?
+	if (sampler_os_count < (1 << (2 * sampler_os_max))) return;
+	sampler_os_count = 0;
+	// Free running sweeps are not evenly spaced so only cached
+	if (sampler_mode == SAMPLER_MODE_ETS)
+	{	// Each sweep is at its own delay from the trigger
+		sampler_emit(sampler_sweep);
+		ets_sweep();
+		return;
+	}
+	if (sampler_mode != SAMPLER_MODE_TIMED) return;
+
+	if (sampler_peak > 1)
+	{	// Track lowest and highest of each channel in bucket
+		for (ch = 0; ch < sampler_nr_of_ch; ch++)
+		{
+			val = sampler_sweep[ch];
+			if ((sampler_peak_count == 0) || (val < sampler_peak_min[ch])) sampler_peak_min[ch] = val;
+			if ((sampler_peak_count == 0) || (val > sampler_peak_max[ch])) sampler_peak_max[ch] = val;
+		}
+		if (++sampler_peak_count < sampler_peak) return;
+		sampler_peak_count = 0;
+		sampler_emit(sampler_peak_min);
+		sampler_emit(sampler_peak_max);
+	}
+	else sampler_emit(sampler_sweep);
+}
+
+
+
+/**
+ * \fn static uint32_t sampler_adc_clock(struct adc_config* conf, uint32_t clk)
+ * \brief Sets ADC prescaler for a clock inside the datasheet range.
+ * \param conf ADC configuration
+ * \param clk Requested ADC clock in Hz
+ * \returns ADC clock in Hz obtained
+ *
+ * ASF rounds the clock down, a request near \ref SAMPLER_ADC_CLOCK_MIN is raised
+ * to the next prescaler above the minimum instead.
+ */
+static uint32_t sampler_adc_clock(struct adc_config* conf, uint32_t clk)
+{
+	uint32_t per;
+
+	per = sysclk_get_per_hz();
+	if (clk < SAMPLER_ADC_CLOCK_MIN) clk = SAMPLER_ADC_CLOCK_MIN;
+	if (clk > SAMPLER_ADC_CLOCK_MAX) clk = SAMPLER_ADC_CLOCK_MAX;
+	adc_set_clock_rate(conf, clk);
+	while ((conf->prescaler > ADC_PRESCALER_DIV4_gc) && ((per / (4UL << conf->prescaler)) < SAMPLER_ADC_CLOCK_MIN)) conf->prescaler--;
+	return per / (4UL << conf->prescaler);
+}
+
+
+
+/**
+ * \fn static void sampler_dma_done(uint8_t block)
+ * \brief Called when DMA has filled a block.
+ * \param block Block number 0 or 1
+ *
+ * Called from interrupt. Updates the cache from the block in place of the per sweep interrupt.
+ */
+static void sampler_dma_done(uint8_t block)
+{
+	uint16_t* p;
+	uint8_t i;
+	uint8_t ch;
+	uint16_t val;
+
+	p = &sampler_buf[block * SAMPLER_BLOCKSIZE];
+	// Other block now being overwritten before it was released?
+	if (sampler_full & (1 << (block ^ 1))) sampler_overruns++;
+	sampler_full |= (1 << block);
+
+	// Correct in place and update cache
+	ch = 0;
+	for (i = 0; i < sampler_block_len; i++)
+	{
+		val = p[i];
+		if (val & 0x8000) val = 0;
+		val = calib_apply(ch, val, 0);
+		p[i] = val;
+		if (val < sampler_cache[ch].min) sampler_cache[ch].min = val;
+		if (val > sampler_cache[ch].max) sampler_cache[ch].max = val;
+		if (val > sampler_cache[ch].peak) sampler_cache[ch].peak = val;
+		if (alarm_conf[ch].type != ALARM_TYPE_OFF) alarm_check(ch, val);
+		if (++ch >= sampler_nr_of_ch) ch = 0;
+	}
+	for (ch = 0; ch < sampler_nr_of_ch; ch++)
+	{
+		sampler_cache[ch].latest = p[sampler_block_len - sampler_nr_of_ch + ch];
+	}
+
+	// Check trigger for each sweep in block
+	if ((trigger_state == TRIGGER_STATE_ARMED) || (trigger_state == TRIGGER_STATE_TRIGGERED))
+	{
+		for (i = 0; i < sampler_block_len; i += sampler_nr_of_ch) trigger_sweep(&p[i]);
+	}
+
+	if (sampler_block_callback) sampler_block_callback(p, sampler_block_len);
+}
+
+
+
+/**
+ * \fn static void sampler_il_check(uint16_t* p, uint16_t len)
+ * \brief Checks that interleaved results are in time order.
+ * \param p Corrected results of burst
+ * \param len Number of results, a multiple of the number of ADC channels
+ *
+ * Sets `sampler_il_step` and `sampler_il_mean` and counts a failed burst in `sampler_il_errors`.
+ */
+static void sampler_il_check(uint16_t* p, uint16_t len)
+{
+	uint32_t step[SAMPLER_NR_OF_CHANNELS];
+	uint32_t sum[SAMPLER_NR_OF_CHANNELS];
+	uint16_t lo;
+	uint16_t hi;
+	uint16_t n;
+	uint16_t i;
+	uint8_t k;
+
+	memset(step, 0, sizeof(step));
+	memset(sum, 0, sizeof(sum));
+	for (i = 0; i < len; i++)
+	{	// Position of result in sweep is the ADC channel that converted it
+		k = i % SAMPLER_NR_OF_CHANNELS;
+		sum[k] += p[i];
+		if (i > 0) step[k] += (p[i] > p[i - 1]) ? (p[i] - p[i - 1]) : (p[i - 1] - p[i]);
+	}
+
+	n = len / SAMPLER_NR_OF_CHANNELS;
+	lo = 0xFFFF;
+	hi = 0;
+	for (k = 0; k < SAMPLER_NR_OF_CHANNELS; k++)
+	{	// First result has no step into it
+		sampler_il_mean[k] = sum[k] / n;
+		sampler_il_step[k] = step[k] / ((k == 0) ? (n - 1) : n);
+		if (sampler_il_step[k] < lo) lo = sampler_il_step[k];
+		if (sampler_il_step[k] > hi) hi = sampler_il_step[k];
+	}
+	if (hi > (lo + (lo / 2) + SAMPLER_IL_NOISE)) sampler_il_errors++;
+}
+
+
+
+/**
+ * \fn static void sampler_il_done(void)
+ * \brief Called when DMA has copied an interleaved burst.
+ *
+ * Called from interrupt. Stops the sampler, corrects the burst in place and passes
+ * it on as single channel sweeps.
+ */
+static void sampler_il_done(void)
+{
+	uint16_t* p;
+	uint16_t i;
+	uint16_t val;
+	uint8_t ch;
+
+	// Restores channel inputs
+	sampler_stop();
+
+	p = sampler_buf;
+	ch = sampler_il_ch;
+	for (i = 0; i < SAMPLER_BUFSIZE; i++)
+	{	// Every result is from the same pin
+		val = p[i];
+		if (val & 0x8000) val = 0;
+		val = calib_apply(ch, val, 0);
+		p[i] = val;
+		if (val < sampler_cache[ch].min) sampler_cache[ch].min = val;
+		if (val > sampler_cache[ch].max) sampler_cache[ch].max = val;
+		if (val > sampler_cache[ch].peak) sampler_cache[ch].peak = val;
+		if (alarm_conf[ch].type != ALARM_TYPE_OFF) alarm_check(ch, val);
+	}
+	sampler_cache[ch].latest = p[SAMPLER_BUFSIZE - 1];
+	sampler_il_check(p, SAMPLER_BUFSIZE);
+
+	if ((trigger_state == TRIGGER_STATE_ARMED) || (trigger_state == TRIGGER_STATE_TRIGGERED))
+	{
+		for (i = 0; i < SAMPLER_BUFSIZE; i++) trigger_sweep(&p[i]);
+	}
+
+	// Burst fills both blocks
+	sampler_full = 3;
+	sampler_read = 0;
+	if (sampler_block_callback)
+	{
+		sampler_block_callback(&p[0], sampler_block_len);
+		sampler_block_callback(&p[SAMPLER_BLOCKSIZE], sampler_block_len);
+	}
+}
+
+
+
+/**
+ * \fn static void sampler_dma_ch0_callback(enum dma_channel_status status)
+ * \brief Called when DMA channel filling first block completes.
+ * \param status DMA channel status
+ */
+static void sampler_dma_ch0_callback(enum dma_channel_status status)
+{
+	if (status != DMA_CH_TRANSFER_COMPLETED) return;
+	if (sampler_mode == SAMPLER_MODE_INTERLEAVED) sampler_il_done();
+	else sampler_dma_done(0);
+}
+
+
+
+/**
+ * \fn static void sampler_dma_ch1_callback(enum dma_channel_status status)
+ * \brief Called when DMA channel filling second block completes.
+ * \param status DMA channel status
+ */
+static void sampler_dma_ch1_callback(enum dma_channel_status status)
+{
+	if (status == DMA_CH_TRANSFER_COMPLETED) sampler_dma_done(1);
+}
+
+
+
+/**
+ * \fn static void sampler_dma_config(dma_channel_num_t num, uint16_t* dest, uint16_t len, bool repeat)
+ * \brief Configures DMA channel to copy ADC sweeps into a block.
+ * \param num DMA channel
+ * \param dest Start of block
+ * \param len Samples in block
+ * \param repeat Repeat forever, otherwise stop after one block
+ *
+ * Each ADC group request moves CH0RES..CH3RES in one 8 byte burst. The destination
+ * reloads at the end of each block.
+ */
+static void sampler_dma_config(dma_channel_num_t num, uint16_t* dest, uint16_t len, bool repeat)
+{
+	struct dma_channel_config dmach_conf;
+
+	memset(&dmach_conf, 0, sizeof(dmach_conf));
+	dma_channel_set_burst_length(&dmach_conf, DMA_CH_BURSTLEN_8BYTE_gc);
+	dma_channel_set_single_shot(&dmach_conf);
+	if (repeat)
+	{
+		dma_channel_set_repeat(&dmach_conf);
+		dma_channel_set_repeats(&dmach_conf, 0);
+	}
+	dma_channel_set_interrupt_level(&dmach_conf, DMA_INT_LVL_LO);
+	dma_channel_set_src_reload_mode(&dmach_conf, DMA_CH_SRCRELOAD_BURST_gc);
+	dma_channel_set_src_dir_mode(&dmach_conf, DMA_CH_SRCDIR_INC_gc);
+	dma_channel_set_dest_reload_mode(&dmach_conf, DMA_CH_DESTRELOAD_BLOCK_gc);
+	dma_channel_set_dest_dir_mode(&dmach_conf, DMA_CH_DESTDIR_INC_gc);
+	dma_channel_set_trigger_source(&dmach_conf, DMA_CH_TRIGSRC_ADCA_CH4_gc);
+	dma_channel_set_transfer_count(&dmach_conf, len * sizeof(uint16_t));
+	dma_channel_set_source_address(&dmach_conf, (uint16_t)(uintptr_t)&ADCA.CH0RES);
+	dma_channel_set_destination_address(&dmach_conf, (uint16_t)(uintptr_t)dest);
+	dma_channel_write_config(num, &dmach_conf);
+}
+
+
+
+/**
+ * \fn void sampler_init(void)
+ * \brief Initializes event system and starts default acquisition.
+ *
+ * Must be called after hardware_init() has configured the ADC channels.
+ */
+void sampler_init(void)
+{
+	// Event system clock
+	sysclk_enable_module(SYSCLK_PORT_GEN, SYSCLK_EVSYS);
+	// Timer clocking the sweeps
+	tc_enable(&SAMPLER_TIMER);
+
+	adc_set_callback(&ADCA, sampler_adc_callback);
+
+	// DMA channels used in pairs to fill alternate blocks
+	dma_enable();
+	dma_set_double_buffer_mode(DMA_DBUFMODE_CH01_gc);
+	dma_set_callback(SAMPLER_DMA_CH0, sampler_dma_ch0_callback);
+	dma_set_callback(SAMPLER_DMA_CH1, sampler_dma_ch1_callback);
+
+	sampler_mode = SAMPLER_MODE_OFF;
+	sampler_nr_of_ch = SAMPLER_NR_OF_CHANNELS;
+	sampler_bits = 12;
+	memset(sampler_os, 0, sizeof(sampler_os));
+	sampler_os_max = 0;
+	sampler_peak = 0;
+	sampler_start(SAMPLER_MODE_TIMED, SAMPLER_RATE_DEFAULT);
+}
+
+
+
+/**
+ * \fn void sampler_start(enum sampler_modes mode, uint32_t rate)
+ * \brief Starts acquisition in required mode.
+ * \param mode Sampler mode
+ * \param rate Sweep rate in Hz (limited to \ref SAMPLER_RATE_MAX)
+ *
+ * Any acquisition already running is stopped, both blocks are emptied and the
+ * lowest and highest results are reset. In free running mode the rate is approximate and
+ * the rate obtained is in `sampler_rate`. Free running rates that would need an ADC clock below
+ * \ref SAMPLER_ADC_CLOCK_MIN run in timed mode instead. DMA mode needs all four channels in the sweep.
+ */
+void sampler_start(enum sampler_modes mode, uint32_t rate)
+{
+	struct adc_config adc_conf;
+	struct adc_channel_config adcch_conf;
+	uint8_t ch;
+	uint8_t cycles;
+
+	sampler_stop();
+	if (mode == SAMPLER_MODE_OFF) return;
+
+	if (mode == SAMPLER_MODE_INTERLEAVED)
+	{	// One channel of results, ADC clock sets the rate
+		sampler_nr_of_ch = 1;
+		if (rate > SAMPLER_IL_RATE_MAX) rate = SAMPLER_IL_RATE_MAX;
+		if (rate < SAMPLER_ADC_CLOCK_MIN) rate = SAMPLER_ADC_CLOCK_MIN;
+	}
+	else if (rate > SAMPLER_RATE_MAX) rate = SAMPLER_RATE_MAX;
+	if (rate == 0) rate = 1;
+	sampler_rate = rate;
+	if ((mode == SAMPLER_MODE_DMA) && (sampler_nr_of_ch != ADC_NR_OF_CHANNELS)) mode = SAMPLER_MODE_TIMED;
+	cycles = (sampler_bits == 8) ? SAMPLER_CONV_CYCLES_8BIT : SAMPLER_CONV_CYCLES;
+	// Slow free running sweeps would need an ADC clock below the datasheet minimum
+	if ((mode == SAMPLER_MODE_FREERUN) && ((rate * sampler_nr_of_ch * cycles) < SAMPLER_ADC_CLOCK_MIN)) mode = SAMPLER_MODE_TIMED;
+
+	// Empty blocks
+	sampler_block_len = (SAMPLER_BLOCKSIZE / sampler_nr_of_ch) * sampler_nr_of_ch;
+	sampler_i = 0;
+	sampler_fill = 0;
+	sampler_full = 0;
+	sampler_read = 0;
+	sampler_overruns = 0;
+	sampler_os_count = 0;
+	sampler_peak_count = 0;
+	for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+	{
+		sampler_acc[ch] = 0;
+		sampler_cache[ch].min = 0xFFFF;
+		sampler_cache[ch].max = 0;
+		sampler_cache[ch].peak = 0;
+	}
+
+	// Interrupt only on last channel of sweep, none when DMA reads results
+	for (ch = 0; ch < sampler_nr_of_ch; ch++)
+	{
+		adcch_read_configuration(&ADCA, (1 << ch), &adcch_conf);
+		adcch_set_interrupt_mode(&adcch_conf, ADCCH_MODE_COMPLETE);
+		if ((ch == (sampler_nr_of_ch - 1)) && (mode != SAMPLER_MODE_DMA) && (mode != SAMPLER_MODE_INTERLEAVED)) adcch_enable_interrupt(&adcch_conf);
+		else adcch_disable_interrupt(&adcch_conf);
+		adcch_write_configuration(&ADCA, (1 << ch), &adcch_conf);
+	}
+
+	adc_read_configuration(&ADCA, &adc_conf);
+	sampler_mode = mode;
+	if (mode == SAMPLER_MODE_INTERLEAVED)
+	{	// Every ADC channel converts the same pin with the same gain
+		for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++) adcch_read_configuration(&ADCA, (1 << ch), &sampler_il_saved[ch]);
+		for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++)
+		{
+			adcch_conf = sampler_il_saved[sampler_il_ch];
+			adcch_disable_interrupt(&adcch_conf);
+			adcch_write_configuration(&ADCA, (1 << ch), &adcch_conf);
+		}
+		// Pipeline starts a conversion every ADC clock
+		sampler_rate = sampler_adc_clock(&adc_conf, rate);
+		adc_set_conversion_trigger(&adc_conf, ADC_TRIG_FREERUN_SWEEP, SAMPLER_NR_OF_CHANNELS, 0);
+		adc_set_dma_request_group(&adc_conf, SAMPLER_NR_OF_CHANNELS);
+		// One burst fills both blocks and stops
+		dma_set_double_buffer_mode(DMA_DBUFMODE_DISABLED_gc);
+		sampler_dma_config(SAMPLER_DMA_CH0, &sampler_buf[0], SAMPLER_BUFSIZE, false);
+		dma_channel_enable(SAMPLER_DMA_CH0);
+		if (trigger_state != TRIGGER_STATE_OFF) trigger_arm();
+		adc_write_configuration(&ADCA, &adc_conf);
+	}
+	else if (mode == SAMPLER_MODE_FREERUN)
+	{	// Sweep continuously, ADC clock sets the rate
+		sampler_rate = sampler_adc_clock(&adc_conf, rate * sampler_nr_of_ch * cycles) / (sampler_nr_of_ch * cycles);
+		adc_set_conversion_trigger(&adc_conf, ADC_TRIG_FREERUN_SWEEP, sampler_nr_of_ch, 0);
+		adc_write_configuration(&ADCA, &adc_conf);
+	}
+	else
+	{	// Sweep on timer overflow event
+		adc_set_conversion_trigger(&adc_conf, ADC_TRIG_EVENT_SWEEP, sampler_nr_of_ch, SAMPLER_EVCH);
+		if (mode == SAMPLER_MODE_DMA)
+		{	// Request DMA when whole sweep has completed
+			adc_set_dma_request_group(&adc_conf, sampler_nr_of_ch);
+			dma_set_double_buffer_mode(DMA_DBUFMODE_CH01_gc);
+			sampler_dma_config(SAMPLER_DMA_CH0, &sampler_buf[0], sampler_block_len, true);
+			sampler_dma_config(SAMPLER_DMA_CH1, &sampler_buf[SAMPLER_BLOCKSIZE], sampler_block_len, true);
+			// Second channel is enabled by double buffering when first completes
+			dma_channel_enable(SAMPLER_DMA_CH0);
+		}
+		adc_write_configuration(&ADCA, &adc_conf);
+		// Ring layout depends on sweep size
+		if (trigger_state != TRIGGER_STATE_OFF) trigger_arm();
+		// Equivalent-time sampling routes and runs the timer itself
+		if (mode == SAMPLER_MODE_ETS) return;
+		if (sampler_sync)
+		{	// DAC timer starts the sweeps
+			EVSYS.CH0MUX = EVSYS_CHMUX_TCC0_CCA_gc;
+			wave_set_sync(true);
+			sampler_rate = wave_rate;
+		}
+		else
+		{
+			EVSYS.CH0MUX = EVSYS_CHMUX_TCC1_OVF_gc;
+			hardware_set_timer_rate(&SAMPLER_TIMER, rate);
+		}
+	}
+}
+
+
+
+/**
+ * \fn void sampler_stop(void)
+ * \brief Stops acquisition.
+ *
+ * Returns ADC to manual conversions with channel interrupts disabled.
+ */
+void sampler_stop(void)
+{
+	struct adc_config adc_conf;
+	struct adc_channel_config adcch_conf;
+	uint8_t ch;
+
+	// Stop timer
+	tc_write_clock_source(&SAMPLER_TIMER, TC_CLKSEL_OFF_gc);
+	tc_write_count(&SAMPLER_TIMER, 0);
+	EVSYS.CH0MUX = EVSYS_CHMUX_OFF_gc;
+	if (sampler_sync) wave_set_sync(false);
+	ets_stop();
+
+	// Stop DMA
+	dma_channel_disable(SAMPLER_DMA_CH0);
+	dma_channel_disable(SAMPLER_DMA_CH1);
+
+	if (sampler_mode == SAMPLER_MODE_INTERLEAVED)
+	{	// Channels back to their own pins
+		for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++) adcch_write_configuration(&ADCA, (1 << ch), &sampler_il_saved[ch]);
+		dma_set_double_buffer_mode(DMA_DBUFMODE_CH01_gc);
+	}
+
+	// Back to manual conversions
+	adc_read_configuration(&ADCA, &adc_conf);
+	adc_set_conversion_trigger(&adc_conf, ADC_TRIG_MANUAL, 1, 0);
+	adc_set_dma_request_group(&adc_conf, 0);
+	adc_set_clock_rate(&adc_conf, (sampler_bits == 8) ? SAMPLER_ADC_CLOCK_8BIT : SAMPLER_ADC_CLOCK);
+	adc_write_configuration(&ADCA, &adc_conf);
+	for (ch = 0; ch < ADC_NR_OF_CHANNELS; ch++)
+	{
+		adcch_read_configuration(&ADCA, (1 << ch), &adcch_conf);
+		adcch_disable_interrupt(&adcch_conf);
+		adcch_write_configuration(&ADCA, (1 << ch), &adcch_conf);
+	}
+	adc_clear_interrupt_flag(&ADCA, ADC_CH0 | ADC_CH1 | ADC_CH2 | ADC_CH3);
+
+	sampler_mode = SAMPLER_MODE_OFF;
+}
+
+
+
+/**
+ * \fn void sampler_start_interleaved(uint8_t ch, uint32_t rate)
+ * \brief Starts one burst of all ADC channels interleaved on one pin.
+ * \param ch Channel whose pin and gain are used, 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param rate Samples per second (limited to \ref SAMPLER_IL_RATE_MAX), the rate used is in `sampler_rate`
+ *
+ * Sweeps are one result from then on, `sampler_nr_of_ch` must be set again before
+ * starting another mode. The sampler stops by itself after \ref SAMPLER_BUFSIZE results.
+ */
+void sampler_start_interleaved(uint8_t ch, uint32_t rate)
+{
+	if (ch >= SAMPLER_NR_OF_CHANNELS) ch = 0;
+	sampler_set_peak(0);
+	sampler_set_oversampling(ch, 0);
+	sampler_il_ch = ch;
+	sampler_start(SAMPLER_MODE_INTERLEAVED, rate);
+}
+
+
+
+/**
+ * \fn void sampler_set_resolution(uint8_t bits)
+ * \brief Sets ADC resolution to 12 or 8 bits.
+ * \param bits 8 for 8 bit results, anything else for 12 bits
+ *
+ * Timed, DMA and free running modes are restarted at the same rate. 8 bit mode turns
+ * off oversampling of all channels. A trigger window already captured keeps the
+ * resolution it was captured with.
+ */
+void sampler_set_resolution(uint8_t bits)
+{
+	struct adc_config adc_conf;
+	enum sampler_modes mode;
+	uint8_t ch;
+
+	mode = sampler_mode;
+	sampler_stop();
+
+	sampler_bits = (bits == 8) ? 8 : 12;
+	if (sampler_bits == 8)
+	{
+		for (ch = 0; ch < SAMPLER_NR_OF_CHANNELS; ch++) sampler_set_oversampling(ch, 0);
+	}
+
+	// Sign and reference are left to auto ranging
+	adc_read_configuration(&ADCA, &adc_conf);
+	adc_conf.ctrlb = (adc_conf.ctrlb & ~ADC_RESOLUTION_gm) | ((sampler_bits == 8) ? ADC_RES_8 : ADC_RES_12);
+	adc_set_clock_rate(&adc_conf, (sampler_bits == 8) ? SAMPLER_ADC_CLOCK_8BIT : SAMPLER_ADC_CLOCK);
+	adc_write_configuration(&ADCA, &adc_conf);
+
+	if ((mode == SAMPLER_MODE_TIMED) || (mode == SAMPLER_MODE_DMA) || (mode == SAMPLER_MODE_FREERUN)) sampler_start(mode, sampler_rate);
+}
+
+
+
+/**
+ * \fn void sampler_set_sync(uint8_t on)
+ * \brief Starts timed and DMA sweeps from the DAC timer or from the sampler timer.
+ * \param on Non zero to start sweeps from `TCC0` compare A
+ *
+ * Timed, DMA and free running modes are restarted. Set the DAC point rate with
+ * wave_set_rate() and the sample offset with wave_set_offset().
+ */
+void sampler_set_sync(uint8_t on)
+{
+	enum sampler_modes mode;
+
+	mode = sampler_mode;
+	sampler_stop();
+	sampler_sync = on;
+	if ((mode == SAMPLER_MODE_TIMED) || (mode == SAMPLER_MODE_DMA) || (mode == SAMPLER_MODE_FREERUN)) sampler_start(mode, sampler_rate);
+}
+
+
+
+/**
+ * \fn void sampler_set_block_callback(sampler_block_callback_t callback)
+ * \brief Sets function called from interrupt when a block completes.
+ * \param callback Function to call or NULL for none
+ *
+ * The block is still passed to sampler_get_block() after the callback returns.
+ */
+void sampler_set_block_callback(sampler_block_callback_t callback)
+{
+	irqflags_t flags;
+
+	flags = cpu_irq_save();
+	sampler_block_callback = callback;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void sampler_set_oversampling(uint8_t ch, uint8_t n)
+ * \brief Sets oversampling of channel.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param n 4^n results are summed and shifted right by n (limited to \ref SAMPLER_OS_MAX)
+ *
+ * Results of the channel have 12 + n bits. Sweeps are passed to blocks and the trigger
+ * at the sweep rate divided by 4^n of the channel with the highest oversampling.
+ * All accumulators restart so channels stay aligned, lowest and highest results of
+ * the channel are reset as its scale changes.
+ */
+void sampler_set_oversampling(uint8_t ch, uint8_t n)
+{
+	irqflags_t flags;
+	uint8_t i;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return;
+	if (n > SAMPLER_OS_MAX) n = SAMPLER_OS_MAX;
+	// 8 bit results are stored as bytes
+	if (sampler_bits == 8) n = 0;
+
+	flags = cpu_irq_save();
+	sampler_os[ch] = n;
+	sampler_os_max = 0;
+	for (i = 0; i < SAMPLER_NR_OF_CHANNELS; i++)
+	{
+		if (sampler_os[i] > sampler_os_max) sampler_os_max = sampler_os[i];
+		sampler_acc[i] = 0;
+	}
+	sampler_os_count = 0;
+	sampler_cache[ch].min = 0xFFFF;
+	sampler_cache[ch].max = 0;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void sampler_set_peak(uint16_t bucket)
+ * \brief Sets peak detect bucket size.
+ * \param bucket Sweeps reduced to one lowest and one highest sweep, 0 or 1 for off
+ *
+ * Applies in timed mode after oversampling. Blocks and the trigger receive pairs of
+ * sweeps so a spike one sweep wide is kept however large the bucket.
+ */
+void sampler_set_peak(uint16_t bucket)
+{
+	irqflags_t flags;
+
+	flags = cpu_irq_save();
+	sampler_peak = bucket;
+	sampler_peak_count = 0;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn uint16_t sampler_read_latest(uint8_t ch)
+ * \brief Returns latest result of channel from cache.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \returns Latest result
+ */
+uint16_t sampler_read_latest(uint8_t ch)
+{
+	irqflags_t flags;
+	uint16_t val;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return 0;
+	flags = cpu_irq_save();
+	val = sampler_cache[ch].latest;
+	cpu_irq_restore(flags);
+	return val;
+}
+
+
+
+/**
+ * \fn void sampler_read_minmax(uint8_t ch, uint16_t* min, uint16_t* max)
+ * \brief Returns lowest and highest result of channel and restarts tracking.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \param min Set to lowest result since last call
+ * \param max Set to highest result since last call
+ *
+ * If no result has arrived since the last call both are set to the latest result.
+ */
+void sampler_read_minmax(uint8_t ch, uint16_t* min, uint16_t* max)
+{
+	irqflags_t flags;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return;
+	flags = cpu_irq_save();
+	*min = sampler_cache[ch].min;
+	*max = sampler_cache[ch].max;
+	if (*min > *max) *min = *max = sampler_cache[ch].latest;
+	sampler_cache[ch].min = 0xFFFF;
+	sampler_cache[ch].max = 0;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn uint16_t sampler_read_peak(uint8_t ch)
+ * \brief Returns highest result of channel and restarts tracking.
+ * \param ch Channel number 0 to \ref SAMPLER_NR_OF_CHANNELS - 1
+ * \returns Highest result since last call
+ *
+ * Tracked separately from sampler_read_minmax() for auto ranging.
+ */
+uint16_t sampler_read_peak(uint8_t ch)
+{
+	irqflags_t flags;
+	uint16_t val;
+
+	if (ch >= SAMPLER_NR_OF_CHANNELS) return 0;
+	flags = cpu_irq_save();
+	val = sampler_cache[ch].peak;
+	sampler_cache[ch].peak = 0;
+	cpu_irq_restore(flags);
+	return val;
+}
+
+
+
+/**
+ * \fn uint16_t* sampler_get_block(uint8_t* len)
+ * \brief Returns oldest completed block or NULL.
+ * \param len Set to number of samples in block
+ * \returns Pointer to block or NULL if no block ready
+ *
+ * Samples are stored in channel order for each sweep. Block must be returned with
+ * sampler_release_block() before another block can be read.
+ */
+uint16_t* sampler_get_block(uint8_t* len)
+{
+	if ((sampler_full & (1 << sampler_read)) == 0) return NULL;
+	*len = sampler_block_len;
+	return &sampler_buf[sampler_read * SAMPLER_BLOCKSIZE];
+}
+
+
+
+/**
+ * \fn void sampler_release_block(void)
+ * \brief Returns block from sampler_get_block() to the sampler.
+ */
+void sampler_release_block(void)
+{
+	irqflags_t flags;
+
+	if ((sampler_full & (1 << sampler_read)) == 0) return;
+	flags = cpu_irq_save();
+	sampler_full &= ~(1 << sampler_read);
+	cpu_irq_restore(flags);
+	sampler_read ^= 1;
+}
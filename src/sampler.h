@@ -0,0 +1,171 @@
+/**
+ * \file sampler.h
+ * \brief Handles background ADC acquisition
+ *
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+
+#define SAMPLER_NR_OF_CHANNELS	4		/**< ADCA channels converted in each sweep */
+#define SAMPLER_BUFSIZE			256		/**< Capture memory in samples shared by all modes */
+#define SAMPLER_BLOCKSIZE		(SAMPLER_BUFSIZE/2)	/**< Samples in each double-buffered block */
+#define SAMPLER_RATE_DEFAULT	1000	/**< Default sweep rate in Hz */
+#define SAMPLER_RATE_MAX		10000	/**< Maximum sweep rate in Hz */
+#define SAMPLER_ADC_CLOCK		200000UL	/**< ADC clock in Hz for timed conversions */
+#define SAMPLER_CONV_CYCLES		7		/**< ADC clock cycles for each 12 bit conversion */
+#define SAMPLER_ADC_CLOCK_MIN	100000UL	/**< Lowest ADC clock in Hz, datasheet minimum */
+#define SAMPLER_ADC_CLOCK_MAX	2000000UL	/**< Highest ADC clock in Hz, datasheet maximum */
+#define SAMPLER_ADC_CLOCK_8BIT	2000000UL	/**< ADC clock in Hz in 8 bit mode, datasheet maximum, limited to peripheral clock / 4 */
+#define SAMPLER_CONV_CYCLES_8BIT	5		/**< ADC clock cycles for each 8 bit conversion */
+#define SAMPLER_OS_MAX			4		/**< Highest oversampling, 4^4 results give 16 bits */
+#define SAMPLER_IL_RATE_MAX		250000UL	/**< Maximum interleaved rate in Hz, DMA must move each sweep before the next */
+#define SAMPLER_IL_NOISE		4		/**< Average step in ADC counts allowed for noise by the interleave order check */
+
+#define SAMPLER_TIMER			TCC1	/**< Timer clocking the ADC sweeps */
+#define SAMPLER_EVCH			0		/**< Event channel routing timer overflow to ADC */
+#define SAMPLER_DMA_CH0			0		/**< DMA channel filling first block, paired with SAMPLER_DMA_CH1 */
+#define SAMPLER_DMA_CH1			1		/**< DMA channel filling second block */
+
+
+enum sampler_modes
+{
+	SAMPLER_MODE_OFF,
+	SAMPLER_MODE_TIMED,
+	SAMPLER_MODE_FREERUN,
+	SAMPLER_MODE_DMA,
+	SAMPLER_MODE_ETS,
+	SAMPLER_MODE_INTERLEAVED
+};	/**< Sampler mode enumerations */
+
+
+typedef void (*sampler_block_callback_t)(uint16_t* block, uint8_t len);	/**< Block complete callback, called from interrupt */
+
+
+struct sampler_cache
+{
+	uint16_t latest;	/**< Latest result */
+	uint16_t min;		/**< Lowest result since last sampler_read_minmax() */
+	uint16_t max;		/**< Highest result since last sampler_read_minmax() */
+	uint16_t peak;		/**< Highest result since last sampler_read_peak() */
+};	/**< Result cache kept for each channel */
+
+
+enum sampler_modes sampler_mode;	/**< Current sampler mode */
+uint32_t sampler_rate;				/**< Current sweep rate in Hz */
+uint8_t sampler_nr_of_ch;			/**< Number of channels in each sweep */
+uint8_t sampler_bits;				/**< Bits in each ADC result, 12 or 8 */
+uint8_t sampler_sync;				/**< Non zero when timed and DMA sweeps are started by the DAC timer */
+
+volatile struct sampler_cache sampler_cache[SAMPLER_NR_OF_CHANNELS];	/**< Result cache for each channel */
+volatile uint8_t sampler_overruns;	/**< Number of blocks lost because consumer was too slow */
+uint8_t sampler_os[SAMPLER_NR_OF_CHANNELS];	/**< Oversampling of each channel, 4^n results summed */
+uint16_t sampler_peak;				/**< Sweeps in each peak detect bucket, 0 for off */
+
+uint8_t sampler_il_ch;				/**< Channel whose pin is sampled by all ADC channels in interleaved mode */
+uint16_t sampler_il_errors;			/**< Interleaved bursts failing the order check */
+uint16_t sampler_il_step[SAMPLER_NR_OF_CHANNELS];	/**< Average step into each result position of last interleaved burst */
+uint16_t sampler_il_mean[SAMPLER_NR_OF_CHANNELS];	/**< Average result of each ADC channel in last interleaved burst */
+
+
+
+/**
+ * \fn void sampler_init(void)
+ * \brief Initializes event system and starts default acquisition.
+ */
+void sampler_init(void);
+
+
+/**
+ * \fn void sampler_start(enum sampler_modes mode, uint32_t rate)
+ * \brief Starts acquisition in required mode.
+ */
+void sampler_start(enum sampler_modes mode, uint32_t rate);
+
+
+/**
+ * \fn void sampler_stop(void)
+ * \brief Stops acquisition.
+ */
+void sampler_stop(void);
+
+
+/**
+ * \fn void sampler_start_interleaved(uint8_t ch, uint32_t rate)
+ * \brief Starts one burst of all ADC channels interleaved on one pin.
+ */
+void sampler_start_interleaved(uint8_t ch, uint32_t rate);
+
+
+/**
+ * \fn void sampler_set_resolution(uint8_t bits)
+ * \brief Sets ADC resolution to 12 or 8 bits.
+ */
+void sampler_set_resolution(uint8_t bits);
+
+
+/**
+ * \fn void sampler_set_sync(uint8_t on)
+ * \brief Starts timed and DMA sweeps from the DAC timer or from the sampler timer.
+ */
+void sampler_set_sync(uint8_t on);
+
+
+/**
+ * \fn void sampler_set_block_callback(sampler_block_callback_t callback)
+ * \brief Sets function called from interrupt when a block completes.
+ */
+void sampler_set_block_callback(sampler_block_callback_t callback);
+
+
+/**
+ * \fn void sampler_set_oversampling(uint8_t ch, uint8_t n)
+ * \brief Sets oversampling of channel to 4^n results.
+ */
+void sampler_set_oversampling(uint8_t ch, uint8_t n);
+
+
+/**
+ * \fn void sampler_set_peak(uint16_t bucket)
+ * \brief Sets sweeps reduced to each lowest and highest pair.
+ */
+void sampler_set_peak(uint16_t bucket);
+
+
+/**
+ * \fn uint16_t sampler_read_latest(uint8_t ch)
+ * \brief Returns latest result of channel from cache.
+ */
+uint16_t sampler_read_latest(uint8_t ch);
+
+
+/**
+ * \fn void sampler_read_minmax(uint8_t ch, uint16_t* min, uint16_t* max)
+ * \brief Returns lowest and highest result of channel and restarts tracking.
+ */
+void sampler_read_minmax(uint8_t ch, uint16_t* min, uint16_t* max);
+
+
+/**
+ * \fn uint16_t sampler_read_peak(uint8_t ch)
+ * \brief Returns highest result of channel and restarts tracking.
+ */
+uint16_t sampler_read_peak(uint8_t ch);
+
+
+/**
+ * \fn uint16_t* sampler_get_block(uint8_t* len)
+ * \brief Returns oldest completed block or NULL.
+ */
+uint16_t* sampler_get_block(uint8_t* len);
+
+
+/**
+ * \fn void sampler_release_block(void)
+ * \brief Returns block from sampler_get_block() to the sampler.
+ */
+void sampler_release_block(void);
+
+
+#endif // SAMPLER_H
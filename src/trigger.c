@@ -0,0 +1,263 @@
+/**
+ * \file trigger.c
+ * \brief Triggered acquisition with pre and post trigger memory
+ *
+ * Sweeps from the sampler are written into a ring while the trigger is armed.
+ * When the trigger condition is met the remaining post trigger sweeps are stored
+ * and the ring is frozen so only the window around the event has to be sent.
+ *
+ * Additional information can be found in the [Trigger Guide](\ref TriggerGuide) page.
+ *
+ */
+
+/**
+ * \page TriggerGuide Trigger Guide
+ *
+ * Operation
+ * - trigger_sweep() is called from the sampler interrupt for each sweep in timed and DMA mode
+ * - While armed every sweep is written into a ring of \ref TRIGGER_BUFSIZE samples
+ * - In 8 bit mode samples are stored as bytes and the ring holds twice as many
+ * - The trigger channel is compared with the level after each sweep
+ * - After the trigger the ring keeps filling until the window holds `pre` sweeps from before the trigger
+ * - The window is `length` sweeps, the whole ring when `length` is 0
+ * - The ring is then frozen until it is armed again
+ *
+ * Trigger types
+ * - `r` rising edge, channel must fall below `level - hyst` before it rises to `level`
+ * - `f` falling edge, channel must rise above `level + hyst` before it falls to `level`
+ * - `a` level, channel at or above `level`
+ * - `b` level, channel at or below `level`
+ * - `n` none, first sweep after `pre` and `holdoff` triggers, used by `@cap`
+ *
+ * The trigger is not accepted until `pre` sweeps have been stored and `holdoff` sweeps
+ * have passed since arming, so the pre trigger part of the window is always valid.
+ *
+ * UDP commands
+ * - `@trig<ch>,<type>,<level>[,<hyst>[,<pre>[,<holdoff>[,<length>]]]]` sets trigger and arms, replies `TRIG:<state>`
+ * - `@tarm` arms again with the same settings, replies `TRIG:<state>`
+ * - `@toff` disarms, replies `TRIG:<state>`
+ * - `@tstat` replies `TSTAT:<state>:<length>:<position>`, state 0 off, 1 armed, 2 triggered, 3 done
+ * - `@tread<start>` replies `TREAD<start>:<sample>,<sample>...` from the frozen window in time order
+ *
+ * Samples are in channel order for each sweep, `position` is the first sample of the trigger sweep.
+ *
+ * Defined in \ref trigger.c
+ */
+
+
+#include <asf.h>
+
+#include "hardware.h"
+#include "sampler.h"
+#include "trigger.h"
+
+
+static union
+{
+	uint16_t w[TRIGGER_BUFSIZE];		/**< Samples of more than 8 bits */
+	uint8_t b[TRIGGER_BUFSIZE * 2];		/**< 8 bit samples */
+} trigger_buf;	/**< Ring memory */
+
+static bool trigger_8bit;			/**< Ring holds 8 bit samples, set when armed */
+
+static uint16_t trigger_len;		/**< Samples in ring, whole sweeps only */
+static uint16_t trigger_window;		/**< Samples in captured window */
+static uint8_t trigger_nch;			/**< Samples in each sweep */
+static uint16_t trigger_head;		/**< Index of next sample written, oldest sample when full */
+static uint16_t trigger_wait;		/**< Sweeps after arming before trigger is accepted */
+static uint16_t trigger_count;		/**< Sweeps since arming, stops at trigger_wait */
+static uint16_t trigger_post;		/**< Sweeps still to store after trigger */
+static bool trigger_primed;			/**< Edge trigger has passed hysteresis level */
+
+
+
+/**
+ * \fn void trigger_init(void)
+ * \brief Sets default trigger settings without arming.
+ */
+void trigger_init(void)
+{
+	trigger_state = TRIGGER_STATE_OFF;
+	trigger_conf.ch = 0;
+	trigger_conf.type = TRIGGER_TYPE_RISING;
+	trigger_conf.level = 2048;
+	trigger_conf.hyst = TRIGGER_HYST_DEFAULT;
+	trigger_conf.pre = TRIGGER_PRE_DEFAULT;
+	trigger_conf.holdoff = 0;
+	trigger_conf.length = 0;
+}
+
+
+
+/**
+ * \fn void trigger_arm(void)
+ * \brief Empties ring and waits for trigger.
+ *
+ * Settings in `trigger_conf` are limited to the current sweep size. Must be called
+ * again if the sampler is restarted with a different number of channels.
+ */
+void trigger_arm(void)
+{
+	irqflags_t flags;
+	uint16_t sweeps;
+
+	flags = cpu_irq_save();
+	trigger_nch = sampler_nr_of_ch;
+	trigger_8bit = (sampler_bits == 8);
+	sweeps = (trigger_8bit ? (TRIGGER_BUFSIZE * 2) : TRIGGER_BUFSIZE) / trigger_nch;
+	trigger_len = sweeps * trigger_nch;
+
+	// Keep settings inside ring
+	if (trigger_conf.ch >= trigger_nch) trigger_conf.ch = 0;
+	if ((trigger_conf.length == 0) || (trigger_conf.length > sweeps)) trigger_conf.length = sweeps;
+	if (trigger_conf.pre >= trigger_conf.length) trigger_conf.pre = trigger_conf.length - 1;
+	trigger_window = trigger_conf.length * trigger_nch;
+
+	trigger_head = 0;
+	trigger_count = 0;
+	trigger_wait = trigger_conf.pre;
+	if (trigger_conf.holdoff > trigger_wait) trigger_wait = trigger_conf.holdoff;
+	trigger_primed = false;
+	trigger_state = TRIGGER_STATE_ARMED;
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void trigger_disarm(void)
+ * \brief Stops filling ring.
+ *
+ * Any captured window is lost.
+ */
+void trigger_disarm(void)
+{
+	trigger_state = TRIGGER_STATE_OFF;
+}
+
+
+
+/**
+ * \fn void trigger_sweep(uint16_t* sweep)
+ * \brief Stores one sweep and checks trigger.
+ * \param sweep Results of one sweep in channel order
+ *
+ * Called from the sampler interrupt.
+ */
+void trigger_sweep(uint16_t* sweep)
+{
+	uint8_t ch;
+	uint16_t val;
+	bool fire;
+
+	if ((trigger_state == TRIGGER_STATE_OFF) || (trigger_state == TRIGGER_STATE_DONE)) return;
+
+	if (trigger_8bit)
+	{
+		for (ch = 0; ch < trigger_nch; ch++) trigger_buf.b[trigger_head + ch] = sweep[ch];
+	}
+	else
+	{
+		for (ch = 0; ch < trigger_nch; ch++) trigger_buf.w[trigger_head + ch] = sweep[ch];
+	}
+	trigger_head += trigger_nch;
+	if (trigger_head >= trigger_len) trigger_head = 0;
+
+	if (trigger_state == TRIGGER_STATE_TRIGGERED)
+	{	// Freeze when post trigger part is stored
+		if (--trigger_post == 0) trigger_state = TRIGGER_STATE_DONE;
+		return;
+	}
+
+	// Armed, check trigger channel, oversampled channels can use all 16 bits
+	val = sweep[trigger_conf.ch];
+	fire = false;
+	switch (trigger_conf.type)
+	{
+		case TRIGGER_TYPE_RISING:
+			if (((uint32_t)val + trigger_conf.hyst) < trigger_conf.level) trigger_primed = true;
+			else if (trigger_primed && (val >= trigger_conf.level)) fire = true;
+			break;
+		case TRIGGER_TYPE_FALLING:
+			if (val > ((uint32_t)trigger_conf.level + trigger_conf.hyst)) trigger_primed = true;
+			else if (trigger_primed && (val <= trigger_conf.level)) fire = true;
+			break;
+		case TRIGGER_TYPE_ABOVE:
+			fire = (val >= trigger_conf.level);
+			break;
+		case TRIGGER_TYPE_BELOW:
+			fire = (val <= trigger_conf.level);
+			break;
+		case TRIGGER_TYPE_NONE:
+			fire = true;
+			break;
+	}
+
+	// Pre trigger part or holdoff not complete?
+	if (trigger_count < trigger_wait)
+	{	// Edge seen too early must be primed again
+		if (fire) trigger_primed = false;
+		trigger_count++;
+		return;
+	}
+
+	if (fire)
+	{	// Trigger sweep is first of the post trigger part
+		trigger_post = trigger_conf.length - trigger_conf.pre - 1;
+		if (trigger_post == 0) trigger_state = TRIGGER_STATE_DONE;
+		else trigger_state = TRIGGER_STATE_TRIGGERED;
+	}
+}
+
+
+
+/**
+ * \fn uint16_t trigger_get_length(void)
+ * \brief Returns number of samples in captured window.
+ * \returns Number of samples or 0 if no window has been captured
+ */
+uint16_t trigger_get_length(void)
+{
+	if (trigger_state != TRIGGER_STATE_DONE) return 0;
+	return trigger_window;
+}
+
+
+
+/**
+ * \fn uint16_t trigger_get_position(void)
+ * \brief Returns sample index of trigger in captured window.
+ * \returns Index of first sample of the trigger sweep
+ */
+uint16_t trigger_get_position(void)
+{
+	return trigger_conf.pre * trigger_nch;
+}
+
+
+
+/**
+ * \fn uint8_t trigger_read(uint16_t start, uint16_t* dest, uint8_t n)
+ * \brief Copies samples from captured window in time order.
+ * \param start Index of first sample, 0 is the oldest
+ * \param dest Buffer for samples
+ * \param n Maximum number of samples to copy
+ * \returns Number of samples copied, 0 if no window has been captured
+ */
+uint8_t trigger_read(uint16_t start, uint16_t* dest, uint8_t n)
+{
+	uint16_t i;
+	uint8_t copied;
+
+	if ((trigger_state != TRIGGER_STATE_DONE) || (start >= trigger_window)) return 0;
+
+	// Window ends at head once ring is frozen
+	i = trigger_head + (trigger_len - trigger_window) + start;
+	while (i >= trigger_len) i -= trigger_len;
+	for (copied = 0; (copied < n) && (start + copied < trigger_window); copied++)
+	{
+		dest[copied] = trigger_8bit ? trigger_buf.b[i] : trigger_buf.w[i];
+		if (++i >= trigger_len) i = 0;
+	}
+	return copied;
+}
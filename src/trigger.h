@@ -0,0 +1,101 @@
+/**
+ * \file trigger.h
+ * \brief Handles triggered acquisition
+ *
+ */
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+
+#define TRIGGER_BUFSIZE			256		/**< Ring memory in samples, twice as many in 8 bit mode, whole sweeps are stored */
+#define TRIGGER_PRE_DEFAULT		16		/**< Default sweeps kept before the trigger */
+#define TRIGGER_HYST_DEFAULT	16		/**< Default hysteresis in ADC counts */
+
+
+enum trigger_types
+{
+	TRIGGER_TYPE_RISING,
+	TRIGGER_TYPE_FALLING,
+	TRIGGER_TYPE_ABOVE,
+	TRIGGER_TYPE_BELOW,
+	TRIGGER_TYPE_NONE
+};	/**< Trigger type enumerations, two edges, two levels and immediate */
+
+
+enum trigger_states
+{
+	TRIGGER_STATE_OFF,
+	TRIGGER_STATE_ARMED,
+	TRIGGER_STATE_TRIGGERED,
+	TRIGGER_STATE_DONE
+};	/**< Trigger state enumerations */
+
+
+struct trigger_config
+{
+	uint8_t ch;					/**< Channel compared with level */
+	enum trigger_types type;	/**< Edge or level */
+	uint16_t level;				/**< Level in ADC counts */
+	uint16_t hyst;				/**< Hysteresis in ADC counts, edge must first pass level by this much */
+	uint16_t pre;				/**< Sweeps kept before trigger */
+	uint16_t holdoff;			/**< Sweeps after arming before trigger is accepted */
+	uint16_t length;			/**< Sweeps in captured window, 0 for whole ring */
+};	/**< Trigger settings */
+
+
+volatile enum trigger_states trigger_state;	/**< Current trigger state */
+struct trigger_config trigger_conf;			/**< Current trigger settings */
+
+
+
+/**
+ * \fn void trigger_init(void)
+ * \brief Sets default trigger settings without arming.
+ */
+void trigger_init(void);
+
+
+/**
+ * \fn void trigger_arm(void)
+ * \brief Empties ring and waits for trigger.
+ */
+void trigger_arm(void);
+
+
+/**
+ * \fn void trigger_disarm(void)
+ * \brief Stops filling ring.
+ */
+void trigger_disarm(void);
+
+
+/**
+ * \fn void trigger_sweep(uint16_t* sweep)
+ * \brief Stores one sweep and checks trigger. Called from sampling interrupt.
+ */
+void trigger_sweep(uint16_t* sweep);
+
+
+/**
+ * \fn uint16_t trigger_get_length(void)
+ * \brief Returns number of samples in captured window.
+ */
+uint16_t trigger_get_length(void);
+
+
+/**
+ * \fn uint16_t trigger_get_position(void)
+ * \brief Returns sample index of trigger in captured window.
+ */
+uint16_t trigger_get_position(void);
+
+
+/**
+ * \fn uint8_t trigger_read(uint16_t start, uint16_t* dest, uint8_t n)
+ * \brief Copies samples from captured window in time order.
+ */
+uint8_t trigger_read(uint16_t start, uint16_t* dest, uint8_t n);
+
+
+#endif // TRIGGER_H
@@ -0,0 +1,173 @@
+/**
+ * \file upload.c
+ * \brief Chunked waveform upload over UDP
+ *
+ * Loads a DAC table a few points per datagram into the staging table of the wave module,
+ * checking each chunk and the whole table with CRCs, and commits it to a channel without
+ * stopping the table it plays. Lost chunks are sent again on their own.
+ *
+ * Additional information can be found in the [Upload Guide](\ref UploadGuide) page.
+ *
+ */
+
+/**
+ * \page UploadGuide Upload Guide
+ *
+ * Operation
+ * - `@wb` starts an upload of `<len>` points for a channel and forgets any points received before
+ * - Each `@wu` chunk carries its first point index, a CRC-8 and up to \ref UPLOAD_CHUNK_POINTS points
+ * - A chunk that fails its CRC or does not fit the upload is dropped and not acknowledged
+ * - Chunks may arrive in any order and more than once, each point is marked as received
+ * - `@wc` checks all points are received and the CRC-16 of the whole table, then commits it
+ * - A channel playing its table keeps playing the old table until it wraps or ends, then plays the new one,
+ *   see the [Waveform Guide](\ref WaveGuide)
+ *
+ * Datagrams are limited to \ref HARDWARE_BUFSIZESML characters so the host sends many small chunks.
+ * When a `WU` reply does not come back the host sends that chunk again, `@wm` lists the points still missing.
+ * The host can send `@wc` again if its reply is lost, the last committed CRC replies OK again.
+ *
+ * CRCs
+ * - Chunk CRC-8 is polynomial 0x07 with initial value 0 over the index byte then each point high byte first
+ * - Table CRC-16 is XMODEM, polynomial 0x1021 with initial value 0 over each point high byte first
+ *
+ * UDP commands
+ * - `@wb<ch>,<len>` starts upload, replies `WB<ch>:<len>`, `<len>` 0 when refused while a commit is still waiting
+ * - `@wu<ii><cc><ppp>...` chunk with 2 hex digit index `<ii>`, 2 hex digit CRC-8 `<cc>` and points of 3 hex digits,
+ *   replies `WU<ii>:<points written>`, 0 when dropped
+ * - `@wm` replies `WM<ch>:<received>/<len>:<mask>` with 16 hex digits, 2 for each 8 points, bit 0 first point
+ * - `@wc<cccc>` commits with 4 hex digit CRC-16, replies `WC<ch>:<len>:<result>`,
+ *   result 0 committed, 1 no upload, 2 points missing, 3 CRC wrong, 4 previous commit still waiting
+ *
+ * Defined in \ref upload.c
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "hardware.h"
+#include "wave.h"
+#include "upload.h"
+
+
+static uint16_t upload_done_crc;	/**< CRC-16 of last committed table */
+static bool upload_done;			/**< A table has been committed since the last `@wb` */
+
+
+
+/**
+ * \fn bool upload_begin(uint8_t ch, uint8_t len)
+ * \brief Starts upload of table for channel into staging table.
+ * \param ch DAC channel 0 or 1
+ * \param len Points in the table, 1 to \ref WAVE_TABLE_SIZE
+ * \returns false if refused
+ */
+bool upload_begin(uint8_t ch, uint8_t len)
+{
+	upload_len = 0;
+	upload_done = false;
+	memset(upload_got, 0, sizeof(upload_got));
+	if ((ch >= WAVE_NR_OF_CHANNELS) || (len == 0) || (len > WAVE_TABLE_SIZE)) return false;
+	if (wave_stage_busy()) return false;
+	upload_ch = ch;
+	upload_len = len;
+	return true;
+}
+
+
+
+/**
+ * \fn uint8_t upload_chunk(const char* s)
+ * \brief Checks chunk and writes its points into staging table.
+ * \param s Chunk after `@wu`, index, CRC-8 and points in hex
+ * \returns Number of points written, 0 if dropped
+ */
+uint8_t upload_chunk(const char* s)
+{
+	uint16_t points[UPLOAD_CHUNK_POINTS];
+	int16_t start;
+	int16_t crc;
+	int16_t val;
+	uint8_t check;
+	uint8_t n;
+	uint8_t i;
+
+	if (upload_len == 0) return 0;
+	start = hardware_read_hex(s, 2);
+	crc = hardware_read_hex(s + 2, 2);
+	if ((start < 0) || (crc < 0)) return 0;
+	s += 4;
+
+	check = _crc8_ccitt_update(0, start);
+	n = 0;
+	while ((*s != 0) && (n < UPLOAD_CHUNK_POINTS))
+	{
+		val = hardware_read_hex(s, 3);
+		if (val < 0) return 0;
+		points[n++] = val;
+		check = _crc8_ccitt_update(check, val >> 8);
+		check = _crc8_ccitt_update(check, val & 0xFF);
+		s += 3;
+	}
+	if ((*s != 0) || (n == 0) || (check != crc)) return 0;
+	if ((start + n) > upload_len) return 0;
+
+	n = wave_stage_write(start, points, n);
+	for (i = start; i < (start + n); i++) upload_got[i >> 3] |= (1 << (i & 7));
+	return n;
+}
+
+
+
+/**
+ * \fn uint8_t upload_count(void)
+ * \brief Returns number of points received.
+ */
+uint8_t upload_count(void)
+{
+	uint8_t i;
+	uint8_t n;
+
+	n = 0;
+	for (i = 0; i < upload_len; i++)
+	{
+		if (upload_got[i >> 3] & (1 << (i & 7))) n++;
+	}
+	return n;
+}
+
+
+
+/**
+ * \fn enum upload_results upload_commit(uint16_t crc)
+ * \brief Checks whole table and commits it to channel.
+ * \param crc CRC-16 of the table from the host
+ * \returns Result, \ref UPLOAD_OK when committed
+ *
+ * The upload ends when committed. A repeated commit of the same table replies OK again.
+ */
+enum upload_results upload_commit(uint16_t crc)
+{
+	uint16_t check;
+	uint16_t val;
+	uint8_t i;
+
+	if (upload_len == 0) return (upload_done && (crc == upload_done_crc)) ? UPLOAD_OK : UPLOAD_IDLE;
+	if (upload_count() < upload_len) return UPLOAD_MISSING;
+
+	check = 0;
+	for (i = 0; i < upload_len; i++)
+	{
+		val = wave_stage_read(i);
+		check = _crc_xmodem_update(check, val >> 8);
+		check = _crc_xmodem_update(check, val & 0xFF);
+	}
+	if (check != crc) return UPLOAD_CRC;
+	if (!wave_commit(upload_ch, upload_len)) return UPLOAD_BUSY;
+
+	upload_done_crc = crc;
+	upload_done = true;
+	upload_len = 0;
+	return UPLOAD_OK;
+}
@@ -0,0 +1,58 @@
+/**
+ * \file upload.h
+ * \brief Handles chunked waveform upload
+ *
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+
+#define UPLOAD_CHUNK_POINTS		8		/**< Most points in one chunk, `@wu` and 7 characters each fit \ref HARDWARE_BUFSIZESML */
+
+
+enum upload_results
+{
+	UPLOAD_OK,
+	UPLOAD_IDLE,
+	UPLOAD_MISSING,
+	UPLOAD_CRC,
+	UPLOAD_BUSY
+};	/**< Commit result enumerations */
+
+
+uint8_t upload_ch;		/**< Channel of current upload */
+uint8_t upload_len;		/**< Points in current upload, 0 when none */
+uint8_t upload_got[WAVE_TABLE_SIZE / 8];	/**< Bit mask of points received, bit 0 of byte 0 for point 0 */
+
+
+
+/**
+ * \fn bool upload_begin(uint8_t ch, uint8_t len)
+ * \brief Starts upload of table for channel into staging table.
+ */
+bool upload_begin(uint8_t ch, uint8_t len);
+
+
+/**
+ * \fn uint8_t upload_chunk(const char* s)
+ * \brief Checks chunk and writes its points into staging table.
+ */
+uint8_t upload_chunk(const char* s);
+
+
+/**
+ * \fn uint8_t upload_count(void)
+ * \brief Returns number of points received.
+ */
+uint8_t upload_count(void);
+
+
+/**
+ * \fn enum upload_results upload_commit(uint16_t crc)
+ * \brief Checks whole table and commits it to channel.
+ */
+enum upload_results upload_commit(uint16_t crc);
+
+
+#endif // UPLOAD_H
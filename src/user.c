@@ -14,6 +14,18 @@
  * - `gainspan` enters GainSpan mode where input is echoed directly to GainSpan module
  * - `normal` returns to normal mode when not in GainSpan mode
  *
+ * Serial buffers
+ * - USARTD0 (user) and USARTE0 (GainSpan) receive and send from their RXC and DRE interrupts
+ * - Each circular buffer has one writer and one reader, the interrupt owns one index and the main loop the other
+ * - The writer stores the byte before moving its index, so no interrupts are disabled to share a buffer
+ * - The GainSpan TX writer waits for room when its buffer is full, user output is dropped instead so the
+ *   9600 baud console never stalls the main loop
+ * - The DRE interrupt is enabled by each write and disabled when the buffer empties
+ * - GainSpan input is dropped when the RX buffer is full, user input while a command waits to be processed
+ * - GainSpan RXC runs at medium interrupt level so the sampler and DAC interrupts cannot delay it past the next byte
+ * - GainSpan input is echoed to the user port from user_tick(), echo is dropped rather than delay the main loop
+ * - <CR> are counted by the RX interrupt in \ref gainspan_rxcr_in and by the parsers in \ref gainspan_rxcr_out
+ *
  * Defined in \ref user.c
  */
 
@@ -29,6 +41,110 @@
 #include "gainspan.h"
 
 
+static uint8_t user_echo_rx;	/**< GainSpan RX buffer index of next byte to echo */
+
+
+
+/**
+ * \fn static inline uint8_t user_next(uint8_t i)
+ * \brief Returns next index of circular buffer.
+ * \param i Index in buffer of \ref HARDWARE_BUFSIZE bytes
+ */
+static inline uint8_t user_next(uint8_t i)
+{
+	if (++i >= HARDWARE_BUFSIZE) i = 0;
+	return i;
+}
+
+
+
+/**
+ * \fn ISR(USARTD0_RXC_vect)
+ * \brief Stores user serial input in command buffer.
+ *
+ * Input is dropped while a command waits to be processed, leaving room for the
+ * <LF><CR> and terminator appended by the main loop.
+ */
+ISR(USARTD0_RXC_vect)
+{
+	uint8_t ch;
+	
+	ch = usart_get(USART_USER);
+	if (user_command_ready) return;
+	// Store command in buffer.
+	if (user_i_rx < HARDWARE_BUFSIZE-3) user_buf_rx[user_i_rx++] = ch;
+	// Has <CR> been received?
+	if (ch == 13) user_command_ready = true;
+}
+
+
+
+/**
+ * \fn ISR(USARTD0_DRE_vect)
+ * \brief Sends next byte of user TX buffer, disables itself when empty.
+ */
+ISR(USARTD0_DRE_vect)
+{
+	uint8_t tail;
+	
+	tail = user_tail_tx;
+	if (tail == user_head_tx)
+	{
+		usart_set_dre_interrupt_level(USART_USER, USART_INT_LVL_OFF);
+		return;
+	}
+	usart_put(USART_USER, user_buf_tx[tail]);
+	user_tail_tx = user_next(tail);
+}
+
+
+
+/**
+ * \fn ISR(USARTE0_RXC_vect)
+ * \brief Appends GainSpan input to RX circular buffer.
+ *
+ * Input is dropped when the buffer is full so the parsers never see a partly overwritten response.
+ */
+ISR(USARTE0_RXC_vect)
+{
+	uint8_t ch;
+	uint8_t head;
+	
+	ch = usart_get(USART_GAINSPAN);
+	head = user_next(gainspan_head_rx);
+	if (head == gainspan_tail_rx) return;
+	gainspan_buf_rx[gainspan_head_rx] = ch;
+	gainspan_head_rx = head;
+	// Any <CR>?
+	if (ch == 13) gainspan_rxcr_in++;
+	// Nearly full, ask module to stop
+	if (gainspan_RXspace() <= GAINSPAN_RTS_OFF_SPACE) OUT_RTSE0_OFF;
+}
+
+
+
+/**
+ * \fn ISR(USARTE0_DRE_vect)
+ * \brief Sends next byte of GainSpan TX buffer, disables itself when empty.
+ *
+ * Also disables itself while the module releases CTS, the CTS pin change interrupt
+ * enables it again.
+ */
+ISR(USARTE0_DRE_vect)
+{
+	uint8_t tail;
+	
+	tail = gainspan_tail_tx;
+	if ((tail == gainspan_head_tx) || (gainspan_flow && !IN_CTSE0_ON))
+	{
+		usart_set_dre_interrupt_level(USART_GAINSPAN, USART_INT_LVL_OFF);
+		return;
+	}
+	usart_put(USART_GAINSPAN, gainspan_buf_tx[tail]);
+	gainspan_tail_tx = user_next(tail);
+}
+
+
 
 /**
  * \fn void user_init(void);
@@ -52,8 +168,19 @@ void user_init(void)
 	gainspan_tail_tx = 0;
 	gainspan_head_rx = 0;
 	gainspan_tail_rx = 0;
+	gainspan_rxcr_in = 0;
+	gainspan_rxcr_out = 0;
+	user_echo_rx = 0;
+	gainspan_baud = USART_GAINSPAN_BAUDRATE;
+	gainspan_dma_busy = false;
+	gainspan_flow = false;
 	
 	user_command_ready = false;
+	
+	// Receive by interrupt, TX interrupts are enabled when data is queued.
+	usart_set_rx_interrupt_level(USART_USER, USART_INT_LVL_LO);
+	// GainSpan input must not wait behind the sampler and DAC interrupts
+	usart_set_rx_interrupt_level(USART_GAINSPAN, USART_INT_LVL_MED);
 }
 
 
@@ -61,58 +188,29 @@ void user_init(void)
 
 /**
  * \fn void user_tick(void)
- * \brief Checks for serial RX and TX from buffer.
+ * \brief Echoes GainSpan RX to the user serial port and asserts GainSpan RTS.
+ *
+ * Bytes are received and sent by the USART interrupts, this only copies GainSpan input
+ * to the user TX buffer. An echo that would wait for the user port is dropped.
  */
 void user_tick(void)
 {
-	// Byte received from USART.
-	uint8_t ch;
-	uint8_t i;
+	uint8_t head;
 	
-	// Any serial input?
-	for(i = 0; i < 10; i++)
-	{	
-		if (usart_rx_is_complete(USART_USER))
-		{
-			usart_serial_getchar(USART_USER, &ch);
-			// Has <CR> been received (if not GainSpan command)?
-			if (ch == 13) user_command_ready = true;
-			// Store command in buffer.
-			if (user_i_rx < HARDWARE_BUFSIZE-1) user_buf_rx[user_i_rx++] = ch;
-		}	
-		// Check GainSpan for input
-		if (usart_rx_is_complete(USART_GAINSPAN))
-		{
-			usart_serial_getchar(USART_GAINSPAN, &ch);
-			// Append to head of circular buffer.
-			user_buf_tx[user_head_tx++] = ch;
-			gainspan_buf_rx[gainspan_head_rx++] = ch;
-			// Wrap around but do not check for overflow.
-			if (user_head_tx >= HARDWARE_BUFSIZE) user_head_tx = 0;
-			if (gainspan_head_rx >= HARDWARE_BUFSIZE) gainspan_head_rx = 0;
-			// Any <CR>?
-			if (ch == 13) gainspan_rxcr++;
+	// Room again for the module to send
+	if (gainspan_RXspace() >= GAINSPAN_RTS_ON_SPACE) OUT_RTSE0_ON;
+	
+	head = gainspan_head_rx;
+	while (user_echo_rx != head)
+	{
+		// Room in user TX buffer?
+		if (user_next(user_head_tx) == user_tail_tx) 
+		{	// Skip rest of echo
+			user_echo_rx = head;
+			break;
 		}
-	}	
-	// Any serial output?
-	if (user_head_tx != user_tail_tx)
-	{	// Some data in buffer.
-		// Get character from tail (first in, first out)
-		ch = user_buf_tx[user_tail_tx++];
-		// Send to USART
-		usart_serial_putchar(USART_USER, ch);
-		// Wrap around buffer?
-		if (user_tail_tx >= HARDWARE_BUFSIZE) user_tail_tx = 0;
-	}
-
-	if (gainspan_head_tx != gainspan_tail_tx)
-	{	// Some data in buffer.
-		// Get character from tail (first in, first out)
-		ch = gainspan_buf_tx[gainspan_tail_tx++];
-		// Send to USART
-		usart_serial_putchar(USART_GAINSPAN, ch);
-		// Wrap around buffer?
-		if (gainspan_tail_tx >= HARDWARE_BUFSIZE) gainspan_tail_tx = 0;
+		user_TXchar(gainspan_buf_rx[user_echo_rx]);
+		user_echo_rx = user_next(user_echo_rx);
 	}
 }
 
@@ -120,7 +218,7 @@ void user_tick(void)
 
 /**
  * \fn void user_mdelay_tick(uint16_t ms)
- * \brief Checks for serial RX and TX from buffer and delays.
+ * \brief Echoes GainSpan RX and delays.
  * \param ms Number milliseconds delay
  *
  * Loops for required delay in milliseconds
@@ -137,6 +235,27 @@ void user_mdelay_tick(uint16_t ms)
 
 
 
+/**
+ * \fn void user_TXchar(char ch)
+ * \brief Adds character to serial TX buffer.
+ * \param ch Character to be sent
+ *
+ * The character is dropped when the buffer is full, the console is too slow to wait for.
+ */
+void user_TXchar(char ch)
+{
+	uint8_t head;
+	
+	head = user_next(user_head_tx);
+	if (head == user_tail_tx) return;
+	// Store character before publishing head to the interrupt.
+	user_buf_tx[user_head_tx] = ch;
+	user_head_tx = head;
+	usart_set_dre_interrupt_level(USART_USER, USART_INT_LVL_LO);
+}
+
+
+
 /**
  * \fn void user_TX(char* buf)
  * \brief Writes character buffer to serial port.
@@ -149,12 +268,7 @@ void user_TX(char* buf)
 	for(i = 0; i < HARDWARE_BUFSIZE; i++)
 	{
 		// Not end of string?
-		if (buf[i] != 0)
-		{	// Append to head of circular buffer.
-			user_buf_tx[user_head_tx++] = buf[i];
-			// Wrap around but do not check for overflow.
-			if (user_head_tx >= HARDWARE_BUFSIZE) user_head_tx = 0;
-		}
+		if (buf[i] != 0) user_TXchar(buf[i]);
 		else break;
 	}
 }
@@ -29,13 +29,13 @@ enum user_commands user_command; /**< Current user command */
 uint8_t user_param;	/**< Current user parameter entered with last command */
 uint16_t user_value;	/**< Current user parameter value entered with last command */
 
-bool user_command_ready;	/**< User detected <CR> - ready to be processed when TRUE */
+volatile bool user_command_ready;	/**< User detected <CR> - ready to be processed when TRUE, set by RX interrupt */
 
 char user_buf_tx[HARDWARE_BUFSIZE];	/**< Serial TX circular buffer */
-uint8_t user_head_tx;	/**< Head index in TX circular buffer */
-uint8_t user_tail_tx;	/**< Tail Index in TX circular buffer */
+volatile uint8_t user_head_tx;	/**< Head index in TX circular buffer, written by main loop */
+volatile uint8_t user_tail_tx;	/**< Tail Index in TX circular buffer, written by DRE interrupt */
 char user_buf_rx[HARDWARE_BUFSIZE];	/**< Serial RX buffer */
-uint8_t user_i_rx;		/**< Index in RX buffer */
+volatile uint8_t user_i_rx;		/**< Index in RX buffer, written by RX interrupt until a command is ready */
 
 
 
@@ -48,18 +48,25 @@ void user_init(void);
 
 /**
  * \fn void user_tick(void)
- * \brief Checks for serial RX and TX from buffer
+ * \brief Echoes GainSpan RX to the user serial port
  */
 void user_tick(void);
 
 
 /**
  * \fn void user_mdelay_tick(uint16_t ms)
- * \brief Checks for serial RX and TX from buffer and delays.
+ * \brief Echoes GainSpan RX and delays.
  */
 void user_mdelay_tick(uint16_t ms);
 
 
+/**
+ * \fn void user_TXchar(char ch)
+ * \brief Adds character to serial TX buffer
+ */
+void user_TXchar(char ch);
+
+
 /**
  * \fn void user_TX(char* buf)
  * \brief Writes character buffer to serial port
@@ -0,0 +1,588 @@
+/**
+ * \file wave.c
+ * \brief Timer clocked DAC waveform playback
+ *
+ * Plays a table of points on each DACB channel at a fixed rate. The conversions are
+ * started by a timer overflow routed through the event system so the output timing
+ * does not depend on interrupt latency, the interrupt only loads the next point.
+ *
+ * Additional information can be found in the [Waveform Guide](\ref WaveGuide) page.
+ *
+ */
+
+/**
+ * \page WaveGuide Waveform Guide
+ *
+ * Operation
+ * - `TCC0` overflow is routed to event channel 3 which triggers DACB conversions of the playing channels
+ * - Each conversion uses the point already waiting in the channel data register
+ * - The `TCC0` overflow interrupt then loads the next point of each playing channel
+ * - Each channel has its own table of \ref WAVE_TABLE_SIZE points, length and mode, both share the point rate
+ * - Loop mode returns to the first point after the last, one shot mode stops with the output at the last point
+ * - The timer only runs while a channel is playing or the sampler is synchronised
+ * - A channel in DDS mode takes its points from the generator of the [DDS Guide](\ref DdsGuide) instead of the table
+ * - A third table is used for staging, a channel committing it swaps it with its own table when the
+ *   played table wraps or ends, the old table becomes the staging table, see the [Upload Guide](\ref UploadGuide)
+ *
+ * Synchronised sampling
+ * - `TCC0` compare A is routed to event channel 0 in place of `TCC1` overflow, so the same timer
+ *   starts the DAC conversions and the ADCA sweeps, see the [Sampler Guide](\ref SamplerGuide)
+ * - Compare A is set from the sample offset, the time from each DAC update to the ADC sweep,
+ *   limited to one point period and rounded to the timer clock
+ * - The sweep rate is the point rate, locked with no interrupt in the path
+ *
+ * A channel not playing converts at once when written, so hardware_write_dac() works as before.
+ * Writing a playing channel is overwritten by the next point.
+ *
+ * Points are 12 bit DAC values, 0 to 4095 for 0V to AVCC.
+ *
+ * UDP commands
+ * - `@wv<ch>,<start>,<point>[,<point>...]` writes points into table of channel from index `<start>`,
+ *   replies `WV<ch>:<start>:<points written>`
+ * - `@wrate<rate>` sets point rate of both channels, replies `WRATE:<rate>`
+ * - `@wplay<ch>,<l|o>,<len>` plays the first `<len>` points of the table in loop (`l`) or one shot (`o`) mode,
+ *   replies `WAVE<ch>:<mode>:<len>:<rate>`
+ * - `@wstop<ch>` stops channel, replies `WAVE<ch>:<mode>:<len>:<rate>`
+ * - `@sync<0|1>[,<offset>]` turns synchronised sampling off or on with sample offset in us,
+ *   replies `SYNC:<on>:<offset>:<rate>`
+ * - `@dv<ch0><ch1>[,<slew>]` sets both outputs at once, each as 3 hex digits or `---` to leave it,
+ *   with optional `<slew>` in counts per ms, replies `DV:<ch0>:<ch1>:<slew>`, -1 for a channel left
+ * - `@dac<ch>,<val>` sets one output at once, `<val>` 0 to 4095, replies on the serial port
+ *
+ * Setting outputs
+ * - Channels set together without slew load their data registers with the trigger on, then one
+ *   strobe of event channel 3 converts both in the same clock, so they never show a mixed state
+ * - With slew each channel moves from its last value to the new one by `<slew> * 1000 / rate`
+ *   counts at each point of the timer, in 8 fraction bits, so large steps become ramps
+ * - Channels slewing together start at the same overflow and stop on their own when they arrive
+ * - Setting a channel stops any table, DDS or slew it was playing
+ *
+ * Defined in \ref wave.c
+ */
+
+
+#include <asf.h>
+
+#include "hardware.h"
+#include "wave.h"
+#include "dds.h"
+
+
+static uint16_t wave_buf[WAVE_NR_OF_CHANNELS + 1][WAVE_TABLE_SIZE];	/**< Tables of both channels and staging table */
+static uint16_t* wave_table[WAVE_NR_OF_CHANNELS];	/**< Table played by each channel */
+static uint16_t* wave_stage;	/**< Staging table */
+static uint8_t wave_stage_len;	/**< Points committed in staging table */
+static volatile uint8_t wave_pending;	/**< Bit mask of channel waiting to swap in the staging table */
+static bool wave_running;		/**< Trigger timer is running */
+static uint32_t wave_request;	/**< Rate requested, gives the same timer period again when the timer is restarted */
+static uint32_t wave_clk;		/**< Timer clock after prescaler in Hz */
+static bool wave_sync;			/**< Sampler sweeps are started by compare A */
+static uint32_t wave_slew_val[WAVE_NR_OF_CHANNELS];		/**< Slewing output with 8 fraction bits */
+static uint32_t wave_slew_target[WAVE_NR_OF_CHANNELS];	/**< Output slewed to with 8 fraction bits */
+static uint32_t wave_slew_step[WAVE_NR_OF_CHANNELS];	/**< Slew for each point with 8 fraction bits */
+
+
+
+/**
+ * \fn static uint16_t wave_set_compare(void)
+ * \brief Sets compare A from the sample offset.
+ * \returns Compare value written
+ *
+ * A running timer takes the new value at its next overflow.
+ */
+static uint16_t wave_set_compare(void)
+{
+	uint32_t cnt;
+
+	cnt = ((uint64_t)wave_offset_us * wave_clk) / 1000000UL;
+	if (cnt > tc_read_period(&WAVE_TIMER)) cnt = tc_read_period(&WAVE_TIMER);
+	if (wave_running) tc_write_cc_buffer(&WAVE_TIMER, TC_CCA, cnt);
+	else tc_write_cc(&WAVE_TIMER, TC_CCA, cnt);
+	return cnt;
+}
+
+
+
+/**
+ * \fn static void wave_check_stop(void)
+ * \brief Stops the timer when no channel is playing and the sampler is not synchronised.
+ *
+ * Must be called with interrupts disabled.
+ */
+static void wave_check_stop(void)
+{
+	uint8_t ch;
+
+	if (wave_sync) return;
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (wave_ch[ch].mode != WAVE_MODE_OFF) return;
+	}
+	tc_write_clock_source(&WAVE_TIMER, TC_CLKSEL_OFF_gc);
+	wave_running = false;
+}
+
+
+
+/**
+ * \fn static void wave_swap(uint8_t ch)
+ * \brief Swaps staging table with table of channel.
+ * \param ch DAC channel 0 or 1
+ *
+ * Must be called with interrupts disabled or from the timer interrupt.
+ */
+static void wave_swap(uint8_t ch)
+{
+	uint16_t* table;
+
+	table = wave_table[ch];
+	wave_table[ch] = wave_stage;
+	wave_stage = table;
+	wave_ch[ch].len = wave_stage_len;
+	wave_pending = 0;
+}
+
+
+
+/**
+ * \fn static uint16_t wave_slew_next(uint8_t ch)
+ * \brief Moves slewing output of channel one step towards its target.
+ * \param ch DAC channel 0 or 1
+ * \returns 12 bit DAC value
+ */
+static uint16_t wave_slew_next(uint8_t ch)
+{
+	if (wave_slew_val[ch] < wave_slew_target[ch])
+	{
+		if ((wave_slew_target[ch] - wave_slew_val[ch]) > wave_slew_step[ch]) wave_slew_val[ch] += wave_slew_step[ch];
+		else wave_slew_val[ch] = wave_slew_target[ch];
+	}
+	else
+	{
+		if ((wave_slew_val[ch] - wave_slew_target[ch]) > wave_slew_step[ch]) wave_slew_val[ch] -= wave_slew_step[ch];
+		else wave_slew_val[ch] = wave_slew_target[ch];
+	}
+	return wave_slew_val[ch] >> 8;
+}
+
+
+
+/**
+ * \fn static void wave_overflow(void)
+ * \brief Loads next point of each playing channel.
+ *
+ * Called from the timer overflow interrupt after the event has started the conversion
+ * of the point in the data register.
+ */
+static void wave_overflow(void)
+{
+	uint8_t ch;
+	uint8_t i;
+	bool playing;
+
+	playing = false;
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (wave_ch[ch].mode == WAVE_MODE_OFF) continue;
+		if (wave_ch[ch].mode == WAVE_MODE_DDS)
+		{	// Generated points have no end
+			dac_set_channel_value(&DACB, (1 << ch), dds_next(ch));
+			playing = true;
+			continue;
+		}
+		if (wave_ch[ch].mode == WAVE_MODE_SLEW)
+		{
+			if (wave_slew_val[ch] == wave_slew_target[ch])
+			{	// Target converted, writes convert at once again
+				wave_ch[ch].mode = WAVE_MODE_OFF;
+				DACB.CTRLB &= ~(DAC_CH0TRIG_bm << ch);
+				continue;
+			}
+			dac_set_channel_value(&DACB, (1 << ch), wave_slew_next(ch));
+			playing = true;
+			continue;
+		}
+		i = wave_ch[ch].i + 1;
+		if (i >= wave_ch[ch].len)
+		{
+			if (wave_pending & (1 << ch)) wave_swap(ch);
+			if (wave_ch[ch].mode == WAVE_MODE_ONESHOT)
+			{	// Last point converted, output holds it and writes convert at once again
+				wave_ch[ch].mode = WAVE_MODE_OFF;
+				DACB.CTRLB &= ~(DAC_CH0TRIG_bm << ch);
+				continue;
+			}
+			i = 0;
+		}
+		wave_ch[ch].i = i;
+		dac_set_channel_value(&DACB, (1 << ch), wave_table[ch][i]);
+		playing = true;
+	}
+
+	if (!playing && !wave_sync)
+	{
+		tc_write_clock_source(&WAVE_TIMER, TC_CLKSEL_OFF_gc);
+		wave_running = false;
+	}
+}
+
+
+
+/**
+ * \fn void wave_init(void)
+ * \brief Initializes DAC trigger timer and event channel.
+ *
+ * Must be called after hardware_init() has configured the DAC and sampler_init()
+ * has enabled the event system.
+ */
+void wave_init(void)
+{
+	uint8_t ch;
+
+	tc_enable(&WAVE_TIMER);
+	tc_set_overflow_interrupt_callback(&WAVE_TIMER, wave_overflow);
+	tc_set_overflow_interrupt_level(&WAVE_TIMER, TC_INT_LVL_LO);
+	EVSYS.CH3MUX = EVSYS_CHMUX_TCC0_OVF_gc;
+	DACB.EVCTRL = WAVE_EVCH;
+
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++) wave_table[ch] = wave_buf[ch];
+	wave_stage = wave_buf[WAVE_NR_OF_CHANNELS];
+	wave_stage_len = 0;
+	wave_pending = 0;
+	wave_running = false;
+	wave_offset_us = 0;
+	wave_sync = false;
+	wave_set_rate(WAVE_RATE_DEFAULT);
+}
+
+
+
+/**
+ * \fn uint8_t wave_write(uint8_t ch, uint8_t start, const uint16_t* val, uint8_t n)
+ * \brief Writes points into table of channel.
+ * \param ch DAC channel 0 or 1
+ * \param start Index of first point
+ * \param val Points to write, 12 bit DAC values
+ * \param n Number of points
+ * \returns Number of points written, limited by the end of the table
+ *
+ * Points of a playing table change at once.
+ */
+uint8_t wave_write(uint8_t ch, uint8_t start, const uint16_t* val, uint8_t n)
+{
+	irqflags_t flags;
+	uint8_t i;
+
+	if ((ch >= WAVE_NR_OF_CHANNELS) || (start >= WAVE_TABLE_SIZE)) return 0;
+	if (n > (WAVE_TABLE_SIZE - start)) n = WAVE_TABLE_SIZE - start;
+	for (i = 0; i < n; i++)
+	{
+		flags = cpu_irq_save();
+		wave_table[ch][start + i] = val[i] & 0x0FFF;
+		cpu_irq_restore(flags);
+	}
+	return n;
+}
+
+
+
+/**
+ * \fn uint8_t wave_stage_write(uint8_t start, const uint16_t* val, uint8_t n)
+ * \brief Writes points into staging table.
+ * \param start Index of first point
+ * \param val Points to write, 12 bit DAC values
+ * \param n Number of points
+ * \returns Number of points written, 0 while a commit is waiting for its channel
+ */
+uint8_t wave_stage_write(uint8_t start, const uint16_t* val, uint8_t n)
+{
+	uint8_t i;
+
+	if ((wave_pending != 0) || (start >= WAVE_TABLE_SIZE)) return 0;
+	if (n > (WAVE_TABLE_SIZE - start)) n = WAVE_TABLE_SIZE - start;
+	for (i = 0; i < n; i++) wave_stage[start + i] = val[i] & 0x0FFF;
+	return n;
+}
+
+
+
+/**
+ * \fn uint16_t wave_stage_read(uint8_t i)
+ * \brief Returns point of staging table.
+ * \param i Index of point
+ * \returns 12 bit DAC value
+ */
+uint16_t wave_stage_read(uint8_t i)
+{
+	if (i >= WAVE_TABLE_SIZE) return 0;
+	return wave_stage[i];
+}
+
+
+
+/**
+ * \fn bool wave_commit(uint8_t ch, uint8_t len)
+ * \brief Makes staging table the table of channel.
+ * \param ch DAC channel 0 or 1
+ * \param len Points of the staging table to play
+ * \returns false if a commit is still waiting
+ *
+ * A channel playing its table keeps playing the old table until it wraps or ends,
+ * so the output never mixes points of both. Other channels swap at once.
+ */
+bool wave_commit(uint8_t ch, uint8_t len)
+{
+	irqflags_t flags;
+
+	if ((ch >= WAVE_NR_OF_CHANNELS) || (len == 0) || (len > WAVE_TABLE_SIZE)) return false;
+	flags = cpu_irq_save();
+	if (wave_pending != 0)
+	{
+		cpu_irq_restore(flags);
+		return false;
+	}
+	wave_stage_len = len;
+	if ((wave_ch[ch].mode == WAVE_MODE_LOOP) || (wave_ch[ch].mode == WAVE_MODE_ONESHOT)) wave_pending = (1 << ch);
+	else wave_swap(ch);
+	cpu_irq_restore(flags);
+	return true;
+}
+
+
+
+/**
+ * \fn bool wave_stage_busy(void)
+ * \brief Returns true while a commit is waiting for its channel.
+ */
+bool wave_stage_busy(void)
+{
+	return (wave_pending != 0);
+}
+
+
+
+/**
+ * \fn uint32_t wave_set_rate(uint32_t rate)
+ * \brief Sets point rate of both channels.
+ * \param rate Points per second (limited to \ref WAVE_RATE_MAX)
+ * \returns Rate set, rounded to the timer period
+ *
+ * Another timer set by hardware_set_timer_rate() with the same requested rate gets the
+ * same period, so it stays locked to the DAC points.
+ */
+uint32_t wave_set_rate(uint32_t rate)
+{
+	uint32_t clk;
+
+	if (rate > WAVE_RATE_MAX) rate = WAVE_RATE_MAX;
+	wave_request = rate;
+	clk = hardware_set_timer_rate(&WAVE_TIMER, rate);
+	if (!wave_running) tc_write_clock_source(&WAVE_TIMER, TC_CLKSEL_OFF_gc);
+	wave_clk = clk;
+	wave_rate = clk / ((uint32_t)tc_read_period(&WAVE_TIMER) + 1);
+	wave_set_compare();
+	return wave_rate;
+}
+
+
+
+/**
+ * \fn void wave_start(uint8_t ch, enum wave_modes mode, uint8_t len)
+ * \brief Starts playback of table on channel.
+ * \param ch DAC channel 0 or 1
+ * \param mode Loop, one shot or DDS
+ * \param len Points played from start of table, 0 for whole table, not used by DDS
+ *
+ * The first point is converted at the next timer overflow. A channel started while
+ * the other is playing keeps its own position in its own table.
+ */
+void wave_start(uint8_t ch, enum wave_modes mode, uint8_t len)
+{
+	if (ch >= WAVE_NR_OF_CHANNELS) return;
+	if (mode == WAVE_MODE_OFF)
+	{
+		wave_stop(ch);
+		return;
+	}
+	wave_start_channels((1 << ch), mode, len);
+}
+
+
+
+/**
+ * \fn void wave_start_channels(uint8_t mask, enum wave_modes mode, uint8_t len)
+ * \brief Starts playback on channels at the same timer overflow.
+ * \param mask Bit mask of channels, bit 0 for channel 0
+ * \param mode Loop, one shot, DDS or slew
+ * \param len Points played from start of table, 0 for whole table, not used by DDS or slew
+ *
+ * All first points are loaded before the timer is started, so the channels stay in step
+ * even when the timer was not running.
+ */
+void wave_start_channels(uint8_t mask, enum wave_modes mode, uint8_t len)
+{
+	irqflags_t flags;
+	uint8_t ch;
+
+	if (mode == WAVE_MODE_OFF) return;
+	if ((len == 0) || (len > WAVE_TABLE_SIZE)) len = WAVE_TABLE_SIZE;
+
+	flags = cpu_irq_save();
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (!(mask & (1 << ch))) continue;
+		if (wave_pending & (1 << ch)) wave_swap(ch);
+		wave_ch[ch].len = len;
+		wave_ch[ch].i = 0;
+		wave_ch[ch].mode = mode;
+		// Trigger first so the first point waits for the event
+		DACB.CTRLB |= (DAC_CH0TRIG_bm << ch);
+		if (mode == WAVE_MODE_DDS) dac_set_channel_value(&DACB, (1 << ch), dds_next(ch));
+		else if (mode == WAVE_MODE_SLEW) dac_set_channel_value(&DACB, (1 << ch), wave_slew_next(ch));
+		else dac_set_channel_value(&DACB, (1 << ch), wave_table[ch][0]);
+	}
+	cpu_irq_restore(flags);
+
+	if ((mask != 0) && !wave_running)
+	{
+		wave_running = true;
+		tc_write_count(&WAVE_TIMER, 0);
+		hardware_set_timer_rate(&WAVE_TIMER, wave_request);
+	}
+}
+
+
+
+/**
+ * \fn void wave_stop(uint8_t ch)
+ * \brief Stops playback on channel.
+ * \param ch DAC channel 0 or 1
+ *
+ * The output keeps the last point converted. The timer stops when no channel is playing
+ * and the sampler is not synchronised.
+ */
+void wave_stop(uint8_t ch)
+{
+	irqflags_t flags;
+
+	if (ch >= WAVE_NR_OF_CHANNELS) return;
+	flags = cpu_irq_save();
+	wave_ch[ch].mode = WAVE_MODE_OFF;
+	DACB.CTRLB &= ~(DAC_CH0TRIG_bm << ch);
+	if (wave_pending & (1 << ch)) wave_swap(ch);
+	wave_check_stop();
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn uint16_t wave_set_offset(uint16_t us)
+ * \brief Sets time from each DAC update to the synchronised ADC sweep.
+ * \param us Offset in us, limited to one point period
+ * \returns Offset set in us, rounded to the timer clock
+ */
+uint16_t wave_set_offset(uint16_t us)
+{
+	irqflags_t flags;
+	uint16_t cnt;
+
+	flags = cpu_irq_save();
+	wave_offset_us = us;
+	// Running timer still has the old value in CCA until its next overflow
+	cnt = wave_set_compare();
+	cpu_irq_restore(flags);
+	return ((uint64_t)cnt * 1000000UL) / wave_clk;
+}
+
+
+
+/**
+ * \fn void wave_set_sync(bool on)
+ * \brief Keeps the timer running for synchronised sampler sweeps.
+ * \param on true while the sampler takes its sweeps from compare A
+ *
+ * Called by the sampler, event channel 0 is routed by sampler_start().
+ */
+void wave_set_sync(bool on)
+{
+	irqflags_t flags;
+
+	flags = cpu_irq_save();
+	wave_sync = on;
+	if (on)
+	{
+		tc_enable_cc_channels(&WAVE_TIMER, TC_CCAEN);
+		if (!wave_running)
+		{
+			wave_running = true;
+			tc_write_count(&WAVE_TIMER, 0);
+			hardware_set_timer_rate(&WAVE_TIMER, wave_request);
+		}
+	}
+	else
+	{
+		tc_disable_cc_channels(&WAVE_TIMER, TC_CCAEN);
+		wave_check_stop();
+	}
+	cpu_irq_restore(flags);
+}
+
+
+
+/**
+ * \fn void wave_set_outputs(uint8_t mask, const uint16_t* val, uint16_t slew)
+ * \brief Sets DAC outputs together.
+ * \param mask Bit mask of channels, bit 0 for channel 0
+ * \param val New value of each channel, 12 bit DAC values
+ * \param slew Counts per ms, 0 to step at once
+ *
+ * Without slew the channels convert their new values in the same clock. With slew they
+ * ramp from their last values at the point rate.
+ */
+void wave_set_outputs(uint8_t mask, const uint16_t* val, uint16_t slew)
+{
+	irqflags_t flags;
+	uint32_t step;
+	uint8_t ch;
+
+	mask &= (1 << WAVE_NR_OF_CHANNELS) - 1;
+	if (mask == 0) return;
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (mask & (1 << ch)) wave_stop(ch);
+	}
+
+	if (slew == 0)
+	{	// Both data registers wait for one event
+		flags = cpu_irq_save();
+		for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+		{
+			if (!(mask & (1 << ch))) continue;
+			DACB.CTRLB |= (DAC_CH0TRIG_bm << ch);
+			dac_set_channel_value(&DACB, (1 << ch), val[ch] & 0x0FFF);
+		}
+		EVSYS.STROBE = (1 << WAVE_EVCH);
+		cpu_irq_restore(flags);
+		for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+		{
+			if (!(mask & (1 << ch))) continue;
+			dac_wait_for_channel_ready(&DACB, (1 << ch));
+			DACB.CTRLB &= ~(DAC_CH0TRIG_bm << ch);
+		}
+		return;
+	}
+
+	// Ramp from the value last written, full range in 1 ms at most
+	if (slew > 4095) slew = 4095;
+	step = ((uint32_t)slew * 256000UL) / wave_rate;
+	if (step == 0) step = 1;
+	for (ch = 0; ch < WAVE_NR_OF_CHANNELS; ch++)
+	{
+		if (!(mask & (1 << ch))) continue;
+		wave_slew_val[ch] = (uint32_t)((ch == 0) ? DACB.CH0DATA : DACB.CH1DATA) << 8;
+		wave_slew_target[ch] = (uint32_t)(val[ch] & 0x0FFF) << 8;
+		wave_slew_step[ch] = step;
+	}
+	wave_start_channels(mask, WAVE_MODE_SLEW, 0);
+}
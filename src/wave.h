@@ -0,0 +1,135 @@
+/**
+ * \file wave.h
+ * \brief Handles timer clocked DAC waveform playback
+ *
+ */
+
+#ifndef WAVE_H
+#define WAVE_H
+
+
+#define WAVE_NR_OF_CHANNELS		2		/**< DACB channels */
+#define WAVE_TABLE_SIZE			64		/**< Points in the table of each channel */
+#define WAVE_RATE_DEFAULT		1000	/**< Default point rate in Hz */
+#define WAVE_RATE_MAX			10000	/**< Maximum point rate in Hz, limited by the refill interrupt */
+
+#define WAVE_TIMER				TCC0	/**< Timer clocking the DAC conversions */
+#define WAVE_EVCH				3		/**< Event channel routing timer overflow to DAC */
+
+
+enum wave_modes
+{
+	WAVE_MODE_OFF,
+	WAVE_MODE_LOOP,
+	WAVE_MODE_ONESHOT,
+	WAVE_MODE_DDS,
+	WAVE_MODE_SLEW
+};	/**< Playback mode enumerations, DDS points come from the generator and slew points ramp to a value instead of the table */
+
+
+struct wave_channel
+{
+	volatile enum wave_modes mode;	/**< Playback mode, one shot returns to off after the last point */
+	uint8_t len;					/**< Points played from the table */
+	volatile uint8_t i;				/**< Point waiting in the DAC data register */
+};	/**< Playback state of one DAC channel */
+
+
+struct wave_channel wave_ch[WAVE_NR_OF_CHANNELS];	/**< Playback state of each DAC channel */
+uint32_t wave_rate;				/**< Current point rate in Hz */
+uint16_t wave_offset_us;		/**< Sample offset after each DAC update in us, as requested */
+
+
+
+/**
+ * \fn void wave_init(void)
+ * \brief Initializes DAC trigger timer and event channel.
+ */
+void wave_init(void);
+
+
+/**
+ * \fn uint8_t wave_write(uint8_t ch, uint8_t start, const uint16_t* val, uint8_t n)
+ * \brief Writes points into table of channel.
+ */
+uint8_t wave_write(uint8_t ch, uint8_t start, const uint16_t* val, uint8_t n);
+
+
+/**
+ * \fn uint8_t wave_stage_write(uint8_t start, const uint16_t* val, uint8_t n)
+ * \brief Writes points into staging table.
+ */
+uint8_t wave_stage_write(uint8_t start, const uint16_t* val, uint8_t n);
+
+
+/**
+ * \fn uint16_t wave_stage_read(uint8_t i)
+ * \brief Returns point of staging table.
+ */
+uint16_t wave_stage_read(uint8_t i);
+
+
+/**
+ * \fn bool wave_commit(uint8_t ch, uint8_t len)
+ * \brief Makes staging table the table of channel when its table next wraps.
+ */
+bool wave_commit(uint8_t ch, uint8_t len);
+
+
+/**
+ * \fn bool wave_stage_busy(void)
+ * \brief Returns true while a commit is waiting for its channel.
+ */
+bool wave_stage_busy(void);
+
+
+/**
+ * \fn uint32_t wave_set_rate(uint32_t rate)
+ * \brief Sets point rate of both channels.
+ */
+uint32_t wave_set_rate(uint32_t rate);
+
+
+/**
+ * \fn void wave_start(uint8_t ch, enum wave_modes mode, uint8_t len)
+ * \brief Starts playback of table on channel.
+ */
+void wave_start(uint8_t ch, enum wave_modes mode, uint8_t len);
+
+
+/**
+ * \fn void wave_start_channels(uint8_t mask, enum wave_modes mode, uint8_t len)
+ * \brief Starts playback on channels at the same timer overflow.
+ */
+void wave_start_channels(uint8_t mask, enum wave_modes mode, uint8_t len);
+
+
+/**
+ * \fn void wave_stop(uint8_t ch)
+ * \brief Stops playback on channel, output keeps last point.
+ */
+void wave_stop(uint8_t ch);
+
+
+/**
+ * \fn uint16_t wave_set_offset(uint16_t us)
+ * \brief Sets time from each DAC update to the synchronised ADC sweep.
+ */
+uint16_t wave_set_offset(uint16_t us);
+
+
+/**
+ * \fn void wave_set_sync(bool on)
+ * \brief Keeps the timer running for synchronised sampler sweeps.
+ */
+void wave_set_sync(bool on);
+
+
+/**
+ * \fn void wave_set_outputs(uint8_t mask, const uint16_t* val, uint16_t slew)
+ * \brief Sets DAC outputs together, at once or slewing by a timer.
+ */
+void wave_set_outputs(uint8_t mask, const uint16_t* val, uint16_t slew);
+
+
+#endif // WAVE_H